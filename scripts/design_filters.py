@@ -29,6 +29,35 @@ def lowpass():
     return system
 
 
+def butterworth_lowpass(sampling_frequency=44_100):
+    """
+    The bass boost lowpass as designed in src/dsp/filter_design.hpp,
+    for comparing against the C++ version. Poles should match; SciPy
+    puts all of the gain in the first section, while the C++ design
+    gives each section unit gain at DC.
+    """
+
+    sos = signal.butter(5, 1000, fs=sampling_frequency, output="sos")
+    pp(sos)
+
+    return sos
+
+
+def to_sos(system):
+    """
+    Factor a designed filter into second-order sections, as used
+    by the C++ filter code. Each row is [b0, b1, b2, 1, a1, a2].
+
+    system : tuple of arrays
+        b_n and a_n coefficients of designed IIR filter.
+    """
+
+    sos = signal.tf2sos(*system)
+    pp(sos)
+
+    return sos
+
+
 def plot_system(system):
     """
     Plot frequency amplitude and phase response of filter.
@@ -64,4 +93,5 @@ def plot_system(system):
 
 if __name__ == "__main__":
     system = lowpass()
+    to_sos(system)
     plot_system(system)
@@ -7,11 +7,97 @@
 
 #include <fmt/format.h>
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+// ---------------------
+// Command-line options.
+
+struct CommandLineOptions {
+    rt_thread::RtOptions mRtOptions;
+    // If set, playback stats are written here periodically; as JSON if it ends in .json.
+    std::string mStatsFile;
+    proc_thread::FftEngine mFftEngine = proc_thread::FftEngine::Double;
+    proc_thread::BandLayout mBandLayout = proc_thread::BandLayout::Octave;
+    bool mWaterfall = false;
+    // If set, messages from the playback thread are appended here instead of shown.
+    std::string mLogFile;
+};
+
+// Supported options:
+//   --rt                 run the playback thread with SCHED_FIFO and locked memory
+//   --rt-priority=<N>    SCHED_FIFO priority (implies --rt)
+//   --rt-cpu=<N>         pin the playback thread to a CPU (implies --rt)
+//   --stats-file=<PATH>  periodically dump playback stats to a file
+//   --fft=float|double   spectrum analysis engine for octave bins (default double)
+//   --bands=octave|third|sixth
+//                        spectrum bands: four octave-ish bins (default), or 1/3 or
+//                        1/6 octave bands from 25 or 50 Hz to 20 kHz, from a 16k-point
+//                        float FFT
+//   --waterfall          show a scrolling spectrogram of the bands
+//   --log-file=<PATH>    append playback thread messages, like xruns, to a file
+static CommandLineOptions parseOptions(int argc, char **argv) {
+    CommandLineOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+
+        if (arg == "--rt") {
+            options.mRtOptions.mEnabled = true;
+        } else if (arg.starts_with("--rt-priority=")) {
+            options.mRtOptions.mEnabled = true;
+            options.mRtOptions.mPriority = std::atoi(argv[i] + std::strlen("--rt-priority="));
+        } else if (arg.starts_with("--rt-cpu=")) {
+            options.mRtOptions.mEnabled = true;
+            options.mRtOptions.mCpu = std::atoi(argv[i] + std::strlen("--rt-cpu="));
+        } else if (arg.starts_with("--stats-file=")) {
+            options.mStatsFile = arg.substr(std::strlen("--stats-file="));
+        } else if (arg == "--fft=float") {
+            options.mFftEngine = proc_thread::FftEngine::Float;
+        } else if (arg == "--fft=double") {
+            options.mFftEngine = proc_thread::FftEngine::Double;
+        } else if (arg == "--bands=octave") {
+            options.mBandLayout = proc_thread::BandLayout::Octave;
+        } else if (arg == "--bands=third") {
+            options.mBandLayout = proc_thread::BandLayout::ThirdOctave;
+        } else if (arg == "--bands=sixth") {
+            options.mBandLayout = proc_thread::BandLayout::SixthOctave;
+        } else if (arg == "--waterfall") {
+            options.mWaterfall = true;
+        } else if (arg.starts_with("--log-file=")) {
+            options.mLogFile = arg.substr(std::strlen("--log-file="));
+        } else {
+            std::cerr << "Ignoring unknown option: " << arg << std::endl;
+        }
+    }
+
+    return options;
+}
+
+// Overwrites the stats file with the latest stats.
+static void dumpStats(const std::string &path, const PlaybackStatsSnapshot &stats) {
+    std::ofstream file{path, std::ios::trunc};
+    file << (path.ends_with(".json") ? stats.toJson() : stats.toText());
+}
+
 // -------------
 // Main program.
 
-int main() {
+int main(int argc, char **argv) {
+    CommandLineOptions options = parseOptions(argc, argv);
+
     AudioPlayer player;
+    player.setRtOptions(options.mRtOptions);
+    player.setFftEngine(options.mFftEngine);
+    player.setBandLayout(options.mBandLayout);
+    if (!player.startLogging(options.mLogFile)) {
+        std::cerr << "Failed to open log file; messages will be shown instead." << std::endl;
+    }
+
     CursesConsole console;
     ConsoleManager manager{console, player};
 
@@ -32,11 +118,8 @@ int main() {
     // ----------------------------
     // Console interface main loop.
 
-    // We sample intensity less often to avoid contention
-    // with the real-time playback thread for atomics.
-    constexpr unsigned int subsampleRate = 2;
-    unsigned int subsampleCounter = 0;
-    float intensitySample = 0.0f;
+    constexpr auto STATS_DUMP_INTERVAL = std::chrono::seconds(1);
+    auto lastStatsDump = std::chrono::steady_clock::now();
 
     while (player.running()) {
         // Update state based on asynchronous tasks.
@@ -49,23 +132,37 @@ int main() {
 
         // Display sound level and progress bar if file loaded.
         if (player.currentState() == State::Playing) {
-            if (subsampleCounter % subsampleRate == 0) {
-                intensitySample =
-                    std::max(0.0f, 0.0f + player.appState().mPlaybackState.mAvgIntensity);
-            }
-            manager.showSoundLevel(intensitySample);
+            const PlaybackSnapshot &snapshot = player.playbackSnapshot();
+            manager.showSoundLevel(std::max(0.0f, snapshot.mAvgIntensity));
 
-            float propDone = static_cast<float>(player.appState().mPlaybackState.mTickNum) /
-                             player.appState().mPlaybackState.mNumTicks;
+            // No ticks once the playback thread has finished.
+            float propDone = 0.0f;
+            if (snapshot.mNumTicks > 0) {
+                propDone = static_cast<float>(snapshot.mTickNum) / snapshot.mNumTicks;
+            }
             manager.showTimeBar(propDone);
 
-            const MainQueue::data_type::array_type &spectrumBins = player.latestSpectrumData();
-            manager.showSpectrumBinLevels(spectrumBins);
+            manager.showSpectrum(player.latestSpectrumData());
+            if (options.mWaterfall) {
+                manager.showWaterfall(player.spectrogram());
+            }
         } else if (player.currentState() == State::Stopped) {
             manager.showSoundLevel(0.0f);
             manager.showTimeBar(0.0f);
         }
 
+        if (!options.mStatsFile.empty() && player.currentState() == State::Playing &&
+            std::chrono::steady_clock::now() - lastStatsDump > STATS_DUMP_INTERVAL) {
+            dumpStats(options.mStatsFile, player.playbackSnapshot().mStats);
+            lastStatsDump = std::chrono::steady_clock::now();
+        }
+
+        // Show messages from the playback thread, e.g. real-time setup results.
+        if (auto message = player.nextLogMessage()) {
+            manager.setEndNote(*message);
+            console.clearBuffer();
+        }
+
         manager.showOptions();
         manager.showEndNote();
 
@@ -90,7 +187,6 @@ int main() {
             }
             console.clearBuffer();
         }
-        subsampleCounter = (subsampleCounter + 1) % subsampleRate;
     }
 
     // -----
@@ -0,0 +1,106 @@
+// Counts allocations per thread at the malloc level.
+//
+// Under AddressSanitizer, which owns malloc, we install the hooks it calls on
+// every allocation. Otherwise we interpose the malloc family and forward to
+// glibc's own implementations, which it exports for this purpose.
+
+#include "alloc_counter.hpp"
+
+#include <cerrno>
+#include <cstddef>
+
+namespace {
+
+thread_local uint64_t tAllocations = 0;
+
+} // namespace
+
+uint64_t alloc_counter::threadAllocations() {
+    return tAllocations;
+}
+
+#if defined(__SANITIZE_ADDRESS__)
+#define ALLOC_COUNTER_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ALLOC_COUNTER_ASAN 1
+#endif
+#endif
+
+#if !defined(NDEBUG) && defined(ALLOC_COUNTER_ASAN)
+
+// From <sanitizer/allocator_interface.h>, which not every toolchain installs.
+extern "C" int __sanitizer_install_malloc_and_free_hooks(
+    void (*mallocHook)(const volatile void *ptr, std::size_t size),
+    void (*freeHook)(const volatile void *ptr));
+
+namespace {
+
+void onMalloc(const volatile void *, std::size_t) {
+    tAllocations++;
+}
+
+void onFree(const volatile void *) {
+}
+
+// Installed during static initialization, before any thread we check starts.
+[[maybe_unused]] const int gHooksInstalled =
+    __sanitizer_install_malloc_and_free_hooks(onMalloc, onFree);
+
+} // namespace
+
+#elif !defined(NDEBUG)
+
+// Each counts one allocation and forwards to glibc. free() isn't replaced,
+// since freeing doesn't need counting and glibc's free pairs with these.
+
+extern "C" {
+
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+
+void *malloc(std::size_t size) {
+    tAllocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) {
+    tAllocations++;
+    return __libc_calloc(count, size);
+}
+
+// Counted even when shrinking, since the loops shouldn't call it at all.
+void *realloc(void *ptr, std::size_t size) {
+    tAllocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) {
+    tAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) {
+    tAllocations++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **out, std::size_t alignment, std::size_t size) {
+    tAllocations++;
+    // Must be a power of two multiple of sizeof(void *).
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *ptr = __libc_memalign(alignment, size);
+    if (ptr == nullptr) {
+        return ENOMEM;
+    }
+    *out = ptr;
+    return 0;
+}
+
+} // extern "C"
+
+#endif // !NDEBUG
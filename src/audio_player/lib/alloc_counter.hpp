@@ -0,0 +1,21 @@
+// Counts heap allocations made by the calling thread, for checking that
+// real-time and analysis loops don't allocate once they are running.
+//
+// Allocations are counted at the malloc level, so operator new and libraries
+// that call malloc directly, like kfr for its aligned buffers, are counted
+// alike. Counting is only done in debug builds; otherwise the count is
+// always zero.
+
+#ifndef ALLOC_COUNTER_H_
+#define ALLOC_COUNTER_H_
+
+#include <cstdint>
+
+namespace alloc_counter {
+
+// Number of malloc-level allocations made by this thread so far.
+uint64_t threadAllocations();
+
+} // namespace alloc_counter
+
+#endif // ALLOC_COUNTER_H_
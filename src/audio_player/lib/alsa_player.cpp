@@ -4,29 +4,42 @@
 
 #include "alsa_player.hpp"
 
-#include "filter.hpp"
+#include "audio_stream.hpp"
+#include "signal_chain.hpp"
 
-#include <cassert>
 #include <cmath>
 #include <cstddef>
 #include <cstdlib>
+#include <ctime>
+#include <span>
+
+#include <unistd.h>
 
 AlsaPlayer::AlsaPlayer(SharedPlaybackState &inState)
     : mState(inState){};
 
-bool AlsaPlayer::init(const std::shared_ptr<const AudioFile> &inFile) {
+// CPU time used by the calling thread.
+static long threadCpuTimeNs() {
+    timespec time{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec * 1'000'000'000L + time.tv_nsec;
+}
+
+bool AlsaPlayer::init(const std::shared_ptr<const AudioFile> &inFile,
+                      const alsa_player::PlaybackOptions &options) {
     mAudioFile = inFile;
 
     unsigned int channels = inFile->channels();
     unsigned int rate = inFile->sampleRate();
 
-    // These should be the only options we see,
-    // but we need to check out assumptions.
-    assert(channels == 1 || channels == 2);
+    // The filters process a frame's channels in SIMD lanes, which bounds the channel count.
+    if (channels < 1 || channels > IIRLowpassFilter::MAX_CHANNELS) {
+        return false;
+    }
 
     mFileInfo = {.mNumChannels = channels, .mSampleRate = rate};
 
-    return initPcm(channels, rate);
+    return initPcm(channels, rate, options);
 }
 
 // Get some ALSA config information.
@@ -47,133 +60,290 @@ void AlsaPlayer::getInfo(AlsaInfo *info, snd_pcm_hw_params_t *mParams) const {
 bool AlsaPlayer::play() {
     using namespace alsa_player;
 
-    if (!mAudioFile || !mPcmHandle || !mAudioFile) {
+    if (!mAudioFile || !mPcmHandle) {
         return false;
     }
 
-    const float *fileData = mAudioFile->data();
-
     std::size_t samplesPerPeriod = mFramesPerPeriod * mFileInfo.mNumChannels;
     // NOTE: This could potentially truncate audio by small amount.
     std::size_t numPeriods = mAudioFile->dataLength() / samplesPerPeriod;
 
+    // Chunks are whole numbers of periods, so periods never straddle chunks.
+    AudioStream stream{mAudioFile, mFramesPerPeriod};
+    stream.start();
+
     // Compute intensity on each buffer write.
     const unsigned int statSamplingInterval = 1;
     float runningAvg = 0.0;
 
-    // How many PCM samples per processing window.
-    std::size_t dataSamplesPerWindow = alsa_player::PROCESSING_WINDOW_SIZE * mFileInfo.mNumChannels;
-
     // ---------------
     // Real-time loop.
 
-    mState.mPlaying = true;
-    mState.mNumTicks = numPeriods;
-    mState.mTickNum = 0;
-
-    // Buffer for data to send to processing thread.
-    AlsaData procData{
-        .data = {0},
-    };
+    mState.mControls.mPlaying.store(true, std::memory_order_relaxed);
+    mSnapshot = PlaybackSnapshot{};
+    mSnapshot.mNumTicks = numPeriods;
 
-    IIRLowpassFilter filter{samplesPerPeriod, mFileInfo.mNumChannels};
+    SignalChain chain{samplesPerPeriod, mFileInfo.mNumChannels, mFileInfo.mSampleRate,
+                      mState.mEqualizer};
     // Buffer to hold processed data to send to device.
     std::vector<float> writeBuffer(samplesPerPeriod, 0.0f);
 
     // Blend of input and filtered signals.
     constexpr float filterMix = 0.5f;
 
-    for (std::size_t i = 0; i < numPeriods && mState.mPlaying; i++) {
-        // Apply filter directly for testing.
-        filter.fillBuffer(fileData, writeBuffer.data(), mState.mBoost ? filterMix : 0.0f);
+    mState.mDevice.mAccessMode.store(mAccessMode, std::memory_order_relaxed);
+    mStats.reset();
+    publishSnapshot();
 
-        // TODOs:
-        //   -- On activating boost need to apply window to avoid click.
-        //   -- Feed the filter-modified signal to the spectral analysis.
-        //   -- Have writeBuffer also hold previous outputs for S.A. use.
+    // Make sure nothing the loop touches will page fault. This matters most
+    // in real-time mode, where memory is locked as it is first touched.
+    rt_thread::prefault(writeBuffer.data(), writeBuffer.size() * sizeof(float));
+    rt_thread::prefault(&chain, sizeof(chain));
+    rt_thread::prefaultStack();
 
-        // NOTE: This knows how many bytes each frame contains.
-        // This will buffer frames for playback by the sound card;
-        // see notes in setBufferSize() definition below.
-        snd_pcm_sframes_t framesWritten =
-            snd_pcm_writei(mPcmHandle, writeBuffer.data(), mFramesPerPeriod);
+    std::size_t i = 0;
 
-        if (framesWritten == -EPIPE) {
-            // An underrun has occurred, which happens when "an application
-            // does not feed new samples in time to alsa-lib (due CPU usage)".
-            //
-            // log("An underrun has occurred while writing to device.\n");
+    while (mState.mControls.mPlaying.load(std::memory_order_relaxed)) {
+        std::span<const float> chunk = stream.acquire();
 
-            snd_pcm_prepare(mPcmHandle);
-        } else if (framesWritten < 0) {
-            // The docs say this could be -EBADFD or -ESTRPIPE.
-            //
-            // log("Failed to write to PCM device: {}\n",
-            //     snd_strerror(static_cast<int>(framesWritten)));
+        if (chunk.empty()) {
+            break;
         }
 
-        // Update running sound intensity estimate.
-        if (i % statSamplingInterval == 0) {
-            // Positive to avoid -inf from log.
-            float frameAvg = 1.0;
-            for (std::size_t j = 0; j < samplesPerPeriod; j++) {
-                frameAvg += fileData[j] * fileData[j];
+        const float *fileData = chunk.data();
+        const float *chunkEnd = chunk.data() + chunk.size();
+
+        for (; fileData + samplesPerPeriod <= chunkEnd &&
+               mState.mControls.mPlaying.load(std::memory_order_relaxed);
+             i++) {
+            bool boost = mState.mControls.mBoost.load(std::memory_order_relaxed);
+            chain.update(boost ? filterMix : 0.0f);
+
+            // In poll mode this returns early if a control event says to stop,
+            // so that stopping doesn't have to wait for room in the buffer.
+            if (!waitForSpace()) {
+                break;
             }
-            // Avgerage with RMS volume in decibels.
-            runningAvg = 0.6 * runningAvg + 0.4 * 10 * std::log(frameAvg);
 
-            mState.mAvgIntensity = runningAvg;
-            mState.mTickNum = i;
-        }
+            long periodStartNs = threadCpuTimeNs();
+
+            if (mAccessMode == AccessMode::Mmap) {
+                writePeriodMmap(chain, fileData);
+            } else {
+                writePeriodReadWrite(chain, fileData, writeBuffer.data());
+            }
+
+            // Update running sound intensity estimate.
+            if (i % statSamplingInterval == 0) {
+                // Positive to avoid -inf from log.
+                float frameAvg = 1.0;
+                for (std::size_t j = 0; j < samplesPerPeriod; j++) {
+                    frameAvg += fileData[j] * fileData[j];
+                }
+                // Avgerage with RMS volume in decibels.
+                runningAvg = 0.6 * runningAvg + 0.4 * 10 * std::log(frameAvg);
+
+                mSnapshot.mAvgIntensity = runningAvg;
+                mSnapshot.mTickNum = i;
+            }
 
-        // Compute information relevant to data sampling.
-        std::size_t currentSample = i * samplesPerPeriod;
-        std::size_t dataSample = (currentSample - dataSamplesPerWindow / 2) / dataSamplesPerWindow;
-        bool shouldSample =
-            (currentSample >= dataSamplesPerWindow / 2) &&
-            ((currentSample - dataSamplesPerWindow / 2) % dataSamplesPerWindow == 0) &&
-            (currentSample + dataSamplesPerWindow / 2 < mAudioFile->dataLength());
-
-        // Send window of data samples to processing thread.
-        if (shouldSample && dataSample > 0) {
-            const float *sampleData = fileData - dataSamplesPerWindow / 2;
-            // NOTE: This could be done more simply, by just sharing the data pointer
-            // offset, since all threads access the data read-only. But, this is also
-            // used as a protoype for other real-time processing that we might do in
-            // the future, where we will do more than simply copy data.
-            for (std::size_t j = 0; j < dataSamplesPerWindow; j++) {
-                if (mFileInfo.mNumChannels == 1) {
-                    procData.data[j] = sampleData[j];
-                } else if (mFileInfo.mNumChannels == 2) {
-                    procData.data[j / 2] = sampleData[j] + sampleData[j + 1];
+            // Thread CPU time doesn't include time spent blocked waiting for the
+            // device, so this is the cost of filtering, transfer, and statistics.
+            long periodNs = threadCpuTimeNs() - periodStartNs;
+            mSnapshot.mPeriodCpuUs =
+                0.99f * mSnapshot.mPeriodCpuUs + 0.01f * (periodNs / 1000.0f);
+            mStats.recordPeriod(periodNs);
+
+            if (i % playback_stats::DELAY_SAMPLING_INTERVAL == 0) {
+                snd_pcm_sframes_t avail = 0;
+                snd_pcm_sframes_t delay = 0;
+                if (snd_pcm_avail_delay(mPcmHandle, &avail, &delay) == 0) {
+                    mStats.recordDelay(delay, avail);
                 }
             }
-            // Drop data and move on if queue is full.
-            bool _ = mState.mProcQueue.queueRef.try_push(procData);
+            publishSnapshot();
+
+            // Increment data pointer to start of next frame.
+            fileData += samplesPerPeriod;
         }
 
-        // Increment data pointer to start of next frame.
-        fileData += samplesPerPeriod;
+        stream.release();
     }
-    mState.mPlaying = false;
+    mState.mControls.mPlaying.store(false, std::memory_order_relaxed);
+
+    // Keep the final stats, but show nothing playing.
+    mSnapshot.mAvgIntensity = 0.0f;
+    mSnapshot.mTickNum = 0;
+    mSnapshot.mNumTicks = 0;
+    publishSnapshot();
 
     return true;
 }
 
+void AlsaPlayer::writePeriodReadWrite(SignalChain &chain, const float *input,
+                                      float *writeBuffer) {
+    chain.process(input, writeBuffer, mFramesPerPeriod);
+
+    // NOTE: This knows how many bytes each frame contains.
+    // This will buffer frames for playback by the sound card;
+    // see notes in setBufferSize() definition below.
+    snd_pcm_sframes_t framesWritten = snd_pcm_writei(mPcmHandle, writeBuffer, mFramesPerPeriod);
+
+    if (framesWritten < 0) {
+        recover(static_cast<int>(framesWritten));
+        return;
+    }
+    // Only what the device took goes to the tap, as with mmap.
+    mState.mTap.publish(writeBuffer, framesWritten * mFileInfo.mNumChannels);
+}
+
+bool AlsaPlayer::waitForSpace() {
+    using namespace alsa_player;
+
+    // snd_pcm_writei blocks until there is room, so there is nothing to do.
+    if (mWaitMode == WaitMode::Blocking && mAccessMode == AccessMode::ReadWrite) {
+        return true;
+    }
+
+    // This follows direct_loop() and write_and_poll_loop()
+    // in the official ALSA example, examples/alsa_official/pcm.c.
+    while (mState.mControls.mPlaying.load(std::memory_order_relaxed)) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(mPcmHandle);
+
+        if (avail < 0) {
+            recover(static_cast<int>(avail));
+            continue;
+        }
+        if (static_cast<snd_pcm_uframes_t>(avail) >= mFramesPerPeriod) {
+            return true;
+        }
+
+        // Writing through mmap doesn't start the stream automatically
+        // like snd_pcm_writei does, so start it once the buffer is full.
+        if (snd_pcm_state(mPcmHandle) == SND_PCM_STATE_PREPARED) {
+            snd_pcm_start(mPcmHandle);
+            continue;
+        }
+
+        if (mWaitMode == WaitMode::Blocking) {
+            if (int err = snd_pcm_wait(mPcmHandle, -1); err < 0) {
+                recover(err);
+            }
+            continue;
+        }
+
+        if (poll(mPollFds.data(), mPollFds.size(), -1) < 0) {
+            // Interrupted by a signal.
+            continue;
+        }
+
+        // A control change; loop around to check whether we should stop.
+        if (mPollFds[0].revents & POLLIN) {
+            mState.mControlEvent.drain();
+        }
+
+        // Let ALSA translate the events, which some plugins require. Errors will
+        // show up in the avail check above, so we don't need to look at them here.
+        unsigned short revents = 0;
+        snd_pcm_poll_descriptors_revents(mPcmHandle, mPollFds.data() + 1, mPollFds.size() - 1,
+                                         &revents);
+    }
+
+    return false;
+}
+
+void AlsaPlayer::writePeriodMmap(SignalChain &chain, const float *input) {
+    const std::size_t nChannels = mFileInfo.mNumChannels;
+    snd_pcm_uframes_t framesLeft = mFramesPerPeriod;
+
+    while (framesLeft > 0) {
+        const snd_pcm_channel_area_t *areas = nullptr;
+        snd_pcm_uframes_t offset = 0;
+        snd_pcm_uframes_t frames = framesLeft;
+
+        if (int err = snd_pcm_mmap_begin(mPcmHandle, &areas, &offset, &frames); err < 0) {
+            recover(err);
+            return;
+        }
+
+        // For interleaved access all channels share the first area,
+        // and its step is the size of a frame in bits.
+        auto *deviceData = static_cast<float *>(areas[0].addr) + areas[0].first / 32 +
+                           offset * (areas[0].step / 32);
+        chain.process(input, deviceData, frames);
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(mPcmHandle, offset, frames);
+
+        if (committed < 0) {
+            recover(static_cast<int>(committed));
+            return;
+        }
+        // Only what the device took goes to the tap. The device won't reuse that
+        // part of its buffer until it has played the rest, so it is still ours to
+        // read. Float samples on the default device go through the plug layer, so
+        // the area is its buffer in ordinary memory, and this reads back what the
+        // chain just wrote while it is still in cache.
+        mState.mTap.publish(deviceData, committed * nChannels);
+
+        // Not an xrun, so it isn't recovered or counted as one. Only this
+        // chunk's frames went through the filters, and the ones the device
+        // didn't take are lost with the rest of the period, which is dropped
+        // unfiltered. The filters' state has then run ahead of what was played
+        // by the uncommitted frames, which is a glitch either way.
+        if (static_cast<snd_pcm_uframes_t>(committed) != frames) {
+            mState.mLogger.log(rt_log::MessageId::ShortCommit, committed, frames);
+            return;
+        }
+
+        input += frames * nChannels;
+        framesLeft -= frames;
+    }
+}
+
+void AlsaPlayer::recover(int error) {
+    if (error == -EPIPE) {
+        // An underrun has occurred, which happens when "an application
+        // does not feed new samples in time to alsa-lib (due CPU usage)".
+        mStats.recordXrun();
+        mState.mLogger.log(rt_log::MessageId::Underrun, mSnapshot.mTickNum, mSnapshot.mNumTicks);
+        snd_pcm_prepare(mPcmHandle);
+    } else if (error == -ESTRPIPE) {
+        // The device was suspended; wait for it to come back.
+        int err;
+        unsigned int waitSeconds = 0;
+        while ((err = snd_pcm_resume(mPcmHandle)) == -EAGAIN) {
+            sleep(1);
+            waitSeconds++;
+        }
+        if (err < 0) {
+            snd_pcm_prepare(mPcmHandle);
+        }
+        mState.mLogger.log(rt_log::MessageId::Suspended, waitSeconds);
+    } else {
+        // The docs say this could be -EBADFD.
+        mState.mLogger.log(rt_log::MessageId::WriteFailed, snd_strerror(error));
+    }
+}
+
 // Clean up and close handle.
 void AlsaPlayer::shutdown() {
     snd_pcm_close(mPcmHandle);
 }
 
 // Setup ALSA PCM.
-bool AlsaPlayer::initPcm(unsigned int numChannels, unsigned int sampleRate) {
+bool AlsaPlayer::initPcm(unsigned int numChannels, unsigned int sampleRate,
+                         const alsa_player::PlaybackOptions &options) {
     // Try opening the device.
     //
     // NOTE: Mode 0 is the default BLOCKING mode.
     // So our calls to snd_pcm_writei below will block
     // until all frames sent are played or buffered.
+    // In poll mode we instead wait for room ourselves.
+
+    mWaitMode = options.mWaitMode;
+    int openMode = mWaitMode == alsa_player::WaitMode::Poll ? SND_PCM_NONBLOCK : 0;
 
-    int pcmResult = snd_pcm_open(&mPcmHandle, PCM_DEVICE, SND_PCM_STREAM_PLAYBACK, 0);
+    int pcmResult = snd_pcm_open(&mPcmHandle, PCM_DEVICE, SND_PCM_STREAM_PLAYBACK, openMode);
 
     if (pcmResult < 0) {
         return false;
@@ -185,10 +355,19 @@ bool AlsaPlayer::initPcm(unsigned int numChannels, unsigned int sampleRate) {
     snd_pcm_hw_params_alloca(&mParams);
     snd_pcm_hw_params_any(mPcmHandle, mParams);
 
-    pcmResult = snd_pcm_hw_params_set_access(mPcmHandle, mParams, SND_PCM_ACCESS_RW_INTERLEAVED);
+    mAccessMode = alsa_player::AccessMode::ReadWrite;
 
-    if (pcmResult < 0) {
-        return false;
+    // Not all devices (or plugins) support mmap access, so we fall back to read/write.
+    if (options.mAccessMode == alsa_player::AccessMode::Mmap &&
+        snd_pcm_hw_params_set_access(mPcmHandle, mParams, SND_PCM_ACCESS_MMAP_INTERLEAVED) >= 0) {
+        mAccessMode = alsa_player::AccessMode::Mmap;
+    } else {
+        pcmResult =
+            snd_pcm_hw_params_set_access(mPcmHandle, mParams, SND_PCM_ACCESS_RW_INTERLEAVED);
+
+        if (pcmResult < 0) {
+            return false;
+        }
     }
 
     // From pcm header: Float 32 bit Little Endian, Range -1.0 to 1.0.
@@ -210,7 +389,7 @@ bool AlsaPlayer::initPcm(unsigned int numChannels, unsigned int sampleRate) {
         return false;
     }
 
-    pcmResult = setBufferSize(mParams);
+    pcmResult = setBufferSize(mParams, options.mLatencyController);
 
     if (pcmResult < 0) {
         return false;
@@ -225,6 +404,16 @@ bool AlsaPlayer::initPcm(unsigned int numChannels, unsigned int sampleRate) {
     snd_pcm_hw_params_get_period_size(mParams, &mFramesPerPeriod, 0);
     snd_pcm_hw_params_get_period_time(mParams, &mHwPeriodTime, nullptr);
 
+    snd_pcm_uframes_t bufferFrames = 0;
+    snd_pcm_hw_params_get_buffer_size(mParams, &bufferFrames);
+    mState.mDevice.mBufferFrames.store(bufferFrames, std::memory_order_relaxed);
+    mState.mDevice.mPeriodFrames.store(mFramesPerPeriod, std::memory_order_relaxed);
+    mState.mDevice.mPeriodTimeUs.store(mHwPeriodTime, std::memory_order_relaxed);
+
+    if (mWaitMode == alsa_player::WaitMode::Poll && !initPoll()) {
+        return false;
+    }
+
     // NOTE: clang address sanitizer says there's a (~3k) memory leak
     // originating here. It may be the stack-allocated alloca memory
     // that is fooling it, but not sure.
@@ -232,7 +421,21 @@ bool AlsaPlayer::initPcm(unsigned int numChannels, unsigned int sampleRate) {
     return true;
 }
 
-int AlsaPlayer::setBufferSize(snd_pcm_hw_params_t *mParams) {
+bool AlsaPlayer::initPoll() {
+    int count = snd_pcm_poll_descriptors_count(mPcmHandle);
+
+    if (count <= 0) {
+        return false;
+    }
+
+    mPollFds.assign(count + 1, pollfd{});
+    mPollFds[0] = {.fd = mState.mControlEvent.fd(), .events = POLLIN, .revents = 0};
+
+    return snd_pcm_poll_descriptors(mPcmHandle, mPollFds.data() + 1, count) == count;
+}
+
+int AlsaPlayer::setBufferSize(snd_pcm_hw_params_t *mParams,
+                              const LatencyController &latencyController) {
     // Set the buffer size here in order to reduce the latency in
     // sending/receiving real-time info to/from the playback loop.
     //
@@ -244,15 +447,19 @@ int AlsaPlayer::setBufferSize(snd_pcm_hw_params_t *mParams) {
     // parameter changes are heard sooner, and it similarly allows sharing
     // statistics on recently played samples by updating shared variables.
 
-    // The intent here for the maximum latency due to buffering in the real-time
-    // playback loop to be 1 / latencyFactor seconds. We may have to adjust this
-    // factor to strike a balance between communication latency and playback
-    // smoothness, if we do much heavy real-time processing in the loop.
+    // The latency controller balances this against playback smoothness:
+    // it starts from a latency based on the sample rate and adjusts it
+    // between playbacks based on the xruns and processing time we measured.
 
     // NOTE: This assumes the sample rate is independent of # channels.
-    constexpr unsigned int latencyFactor = 200;
-    snd_pcm_uframes_t bufferSize = 512; // mFileInfo.mSampleRate / latencyFactor;
-    // TODO: Find better way to set this based on audio sample rate.
+    snd_pcm_uframes_t bufferSize = latencyController.bufferFrames(mFileInfo.mSampleRate);
+    snd_pcm_uframes_t periodSize = latencyController.periodFrames(mFileInfo.mSampleRate);
+
+    int result = snd_pcm_hw_params_set_buffer_size_near(mPcmHandle, mParams, &bufferSize);
+
+    if (result < 0) {
+        return result;
+    }
 
-    return snd_pcm_hw_params_set_buffer_size_max(mPcmHandle, mParams, &bufferSize);
+    return snd_pcm_hw_params_set_period_size_near(mPcmHandle, mParams, &periodSize, nullptr);
 }
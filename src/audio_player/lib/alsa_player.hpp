@@ -7,40 +7,139 @@
 #define ALSA_PLAYER_H
 
 #include "audio_player.hpp"
+#include "equalizer.hpp"
+#include "event_fd.hpp"
+#include "latency_controller.hpp"
+#include "playback_stats.hpp"
+#include "rt_logger.hpp"
 #include "rt_queue.hpp"
+#include "rt_thread.hpp"
 
 #include <alsa/asoundlib.h>
 
 #include <atomic>
 #include <cstddef>
 #include <memory>
+#include <vector>
+
+#include <poll.h>
+
+class SignalChain;
 
 // -------------------------
 // Configuration parameters.
 
 namespace alsa_player {
 
+// Channel-summed frames per block the processing thread analyzes. This is just
+// how the samples are batched; the float engine's STFT sets its own frame
+// size and hop (see proc_thread::STFT_FFT_SIZE).
 static constexpr size_t PROCESSING_WINDOW_SIZE = 512;
 
-using AlsaData = Data<PROCESSING_WINDOW_SIZE>;
-using AlsaDataQueue = QueueHolder<PROCESSING_WINDOW_SIZE>;
+// Samples of filtered output kept for readers of the tap bus: about 0.7 s of
+// stereo at 44.1 kHz, which is plenty of slack for readers that wake up late.
+static constexpr size_t TAP_CAPACITY = 1 << 16;
+
+// How samples are transferred to the device.
+enum class AccessMode {
+    // Filter into our own buffer, which snd_pcm_writei copies into the device buffer.
+    ReadWrite,
+    // Filter directly into the device buffer with snd_pcm_mmap_begin/commit.
+    Mmap,
+};
+
+inline const char *accessModeString(AccessMode mode) {
+    return mode == AccessMode::Mmap ? "mmap" : "read/write";
+}
+
+// How the playback loop waits for room in the device buffer.
+enum class WaitMode {
+    // Let the ALSA calls block, as in the default PCM open mode.
+    Blocking,
+    // Open the PCM non-blocking and poll its descriptors along with a
+    // control eventfd, so that control changes wake the loop immediately.
+    Poll,
+};
+
+inline const char *waitModeString(WaitMode mode) {
+    return mode == WaitMode::Poll ? "poll" : "blocking";
+}
+
+struct PlaybackOptions {
+    AccessMode mAccessMode = AccessMode::ReadWrite;
+    WaitMode mWaitMode = WaitMode::Blocking;
+    rt_thread::RtOptions mRtOptions;
+    // Chooses the buffer and period sizes.
+    LatencyController mLatencyController;
+};
 
 } // namespace alsa_player
 
 // ----------------------------
 // State shared across threads.
 
+// What the UI shows about playback in progress. The playback thread publishes
+// it whole, so the fields always come from the same period.
+struct PlaybackSnapshot {
+    float mAvgIntensity = 0.0f;
+    std::size_t mTickNum = 0;
+    std::size_t mNumTicks = 0;
+
+    // Running average of playback thread CPU time per period, for comparing access modes.
+    float mPeriodCpuUs = 0.0f;
+
+    // Xrun and timing telemetry.
+    PlaybackStatsSnapshot mStats;
+};
+
 struct SharedPlaybackState {
-    SharedPlaybackState(alsa_player::AlsaDataQueue &inProcQueue)
-        : mProcQueue(inProcQueue){};
+    SharedPlaybackState(TapBus &inTap, RtLogger &inLogger)
+        : mTap(inTap),
+          mLogger(inLogger){};
+
+    // Fields are grouped by the thread that writes them, and each group has its
+    // own cache lines, so that a thread's writes don't evict what the other
+    // thread is reading.
+
+    // Written by the UI thread, and read by the playback thread every period.
+    // Relaxed, since they don't publish any other data.
+    struct alignas(CACHE_LINE_SIZE) Controls {
+        std::atomic_bool mPlaying = false;
+        std::atomic_bool mBoost = false;
+    };
 
-    std::atomic_bool mPlaying;
-    std::atomic_bool mBoost;
-    std::atomic<float> mAvgIntensity;
-    std::atomic<std::size_t> mTickNum;
-    std::atomic<std::size_t> mNumTicks;
+    // Written by the playback thread when playback starts, and read by the UI for
+    // display. Relaxed, since nothing depends on them; the UI reads mPeriodTimeUs
+    // after joining the playback thread, and the join orders that.
+    struct alignas(CACHE_LINE_SIZE) DeviceInfo {
+        // Access mode actually in use, which may differ from the one requested.
+        std::atomic<alsa_player::AccessMode> mAccessMode = alsa_player::AccessMode::ReadWrite;
+
+        // Negotiated with the device.
+        std::atomic<std::size_t> mBufferFrames = 0;
+        std::atomic<std::size_t> mPeriodFrames = 0;
+        std::atomic<unsigned int> mPeriodTimeUs = 0;
+    };
 
-    alsa_player::AlsaDataQueue mProcQueue;
+    Controls mControls;
+    DeviceInfo mDevice;
+
+    // Band gains, and the coefficients designed from them. Written by the UI thread.
+    EqualizerControls mEqualizer;
+
+    // Written by the playback thread; only the UI thread may read it.
+    TripleBuffer<PlaybackSnapshot> mSnapshot;
+
+    // The rest never change, so they can share cache lines.
+
+    // Notify this after changing the controls, to wake a polling playback loop.
+    EventFd mControlEvent;
+
+    // Each period of filtered output, interleaved, for any number of analysis readers.
+    TapBus &mTap;
+
+    // For messages from the playback thread.
+    RtLogger &mLogger;
 };
 
 // -----------------------------------------------
@@ -62,7 +161,9 @@ class AlsaPlayer {
   public:
     explicit AlsaPlayer(SharedPlaybackState &inState);
 
-    bool init(const std::shared_ptr<const AudioFile> &inFile);
+    // Falls back to read/write access if the device doesn't support mmap.
+    bool init(const std::shared_ptr<const AudioFile> &inFile,
+              const alsa_player::PlaybackOptions &options = {});
 
     // Get some ALSA config information. Currently unused.
     void getInfo(AlsaInfo *info, snd_pcm_hw_params_t *mParams) const;
@@ -74,9 +175,32 @@ class AlsaPlayer {
 
   private:
     // Setup ALSA PCM.
-    bool initPcm(unsigned int numChannels, unsigned int sampleRate);
+    bool initPcm(unsigned int numChannels, unsigned int sampleRate,
+                 const alsa_player::PlaybackOptions &options);
+
+    // Sets up the descriptors for the polling loop.
+    bool initPoll();
 
-    int setBufferSize(snd_pcm_hw_params_t *mParams);
+    int setBufferSize(snd_pcm_hw_params_t *mParams, const LatencyController &latencyController);
+
+    // Waits until the device can take a full period. Returns early,
+    // with false, if a control event arrives while polling.
+    bool waitForSpace();
+
+    // Process one period of input and send it to the device.
+    void writePeriodReadWrite(SignalChain &chain, const float *input, float *writeBuffer);
+
+    // Processes straight into the device's mmap area, then publishes the
+    // frames the device took to the tap.
+    void writePeriodMmap(SignalChain &chain, const float *input);
+
+    // Tries to get the PCM running again after an xrun or suspend.
+    void recover(int error);
+
+    void publishSnapshot() {
+        mSnapshot.mStats = mStats.snapshot();
+        mState.mSnapshot.publish(mSnapshot);
+    }
 
   private:
     SharedPlaybackState &mState;
@@ -92,6 +216,16 @@ class AlsaPlayer {
     snd_pcm_t *mPcmHandle = nullptr;
     snd_pcm_uframes_t mFramesPerPeriod;
     unsigned int mHwPeriodTime;
+    alsa_player::AccessMode mAccessMode = alsa_player::AccessMode::ReadWrite;
+    alsa_player::WaitMode mWaitMode = alsa_player::WaitMode::Blocking;
+
+    // Owned by this thread, and published through mState.mSnapshot.
+    PlaybackStats mStats;
+    PlaybackSnapshot mSnapshot;
+
+    // The control eventfd followed by the PCM's descriptors. Kept as a
+    // list so that more PCM handles can be serviced by the same loop.
+    std::vector<pollfd> mPollFds;
 };
 
 #endif // ALSA_PLAYER_H
@@ -5,12 +5,15 @@
 #ifndef AUDIO_PLAYER_H
 #define AUDIO_PLAYER_H
 
-#include "threadsafe_queue.hpp"
+#include "mapped_wav.hpp"
 
 #include <kfr/io.hpp>
 
-#include <format>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <optional>
+#include <string>
 
 // -----------------------------------------
 // Utility to make sure a function is called
@@ -35,9 +38,38 @@ class Defer {
 // -------------------------------------------------
 // Provides interface to audio file loaded with kfr.
 
+namespace audio_file {
+
+// Files longer than this many frames are streamed from disk in chunks
+// instead of being decoded into memory all at once. This is about 95
+// seconds of audio at 44.1khz.
+static constexpr std::size_t MAX_FULL_LOAD_FRAMES = std::size_t{1} << 22;
+
+enum class LoadMode {
+    // Decode the whole file into memory when it is opened.
+    Full,
+    // Only read the header; samples are decoded during playback by an AudioStream.
+    Streaming,
+    // Map the file and use its float32 or int16 samples in place.
+    Mapped,
+    // Map the file if possible, otherwise choose Full or Streaming based on its length.
+    Auto,
+};
+
+} // namespace audio_file
+
 class AudioFile {
   public:
-    explicit AudioFile(const std::string &path) {
+    using LoadMode = audio_file::LoadMode;
+    using SampleFormat = mapped_wav::SampleFormat;
+
+    explicit AudioFile(const std::string &path, LoadMode mode = LoadMode::Auto)
+        : mPath(path) {
+        if ((mode == LoadMode::Mapped || mode == LoadMode::Auto) && tryMap()) {
+            mLoadMode = LoadMode::Mapped;
+            return;
+        }
+
         auto file = kfr::open_file_for_reading(path);
 
         if (file == nullptr) {
@@ -47,8 +79,23 @@ class AudioFile {
         kfr::audio_reader_wav<float> reader{file};
         mFormat = reader.format();
 
-        // For now we just read all samples at once.
-        mData = reader.read(mFormat.length * mFormat.channels);
+        // Everything below divides by the channel count.
+        if (mFormat.channels == 0) {
+            throw std::runtime_error("File has no channels.");
+        }
+
+        if (mode == LoadMode::Mapped || mode == LoadMode::Auto) {
+            auto frames = static_cast<std::size_t>(mFormat.length);
+            mode = frames > audio_file::MAX_FULL_LOAD_FRAMES ? LoadMode::Streaming
+                                                             : LoadMode::Full;
+        }
+        mLoadMode = mode;
+
+        if (mLoadMode == LoadMode::Full) {
+            mData = reader.read(mFormat.length * mFormat.channels);
+            // In case the file was shorter than its header claimed.
+            mFormat.length = mData.size() / mFormat.channels;
+        }
     }
 
     [[nodiscard]] unsigned int sampleRate() const {
@@ -66,44 +113,112 @@ class AudioFile {
         return mFormat.channels;
     }
 
+    [[nodiscard]] LoadMode loadMode() const {
+        return mLoadMode;
+    }
+
+    // True if samples must be decoded during playback
+    // because data() can't point at them directly.
+    [[nodiscard]] bool isStreaming() const {
+        return data() == nullptr;
+    }
+
+    [[nodiscard]] const std::string &path() const {
+        return mPath;
+    }
+
+    // Returns nullptr unless the float samples are in memory or mapped.
     const float *data() const {
-        return mData.data();
+        if (mLoadMode == LoadMode::Mapped) {
+            return mMappedFormat == SampleFormat::Float32
+                       ? reinterpret_cast<const float *>(mMappedSamples)
+                       : nullptr;
+        }
+        return mLoadMode == LoadMode::Full ? mData.data() : nullptr;
     }
 
-    [[nodiscard]] std::size_t dataLength() const {
-        return mData.size();
+    // Samples of a mapped int16 file, or nullptr.
+    const int16_t *mappedInt16Data() const {
+        bool isInt16 = mLoadMode == LoadMode::Mapped && mMappedFormat == SampleFormat::Int16;
+        return isInt16 ? reinterpret_cast<const int16_t *>(mMappedSamples) : nullptr;
     }
 
-  private:
-    kfr::univector<float> mData;
-    kfr::audio_format_and_length mFormat;
-};
+    // Total number of (interleaved) samples in the file, whether or not they are in memory.
+    [[nodiscard]] std::size_t dataLength() const {
+        return static_cast<std::size_t>(mFormat.length) * mFormat.channels;
+    }
 
-// ----------------------------------
-// Class to handle logging by putting
-// messages into a thread-safe queue.
+    // Hints that samples [offset, offset + count) will be read soon. This
+    // only does something for mapped files, where it starts readahead.
+    void prefetch(std::size_t offset, std::size_t count) const {
+        if (mMappedFile) {
+            mMappedFile->prefetch(mappedByteOffset(offset), count * mappedSampleBytes());
+        }
+    }
 
-using MessageQueue = ThreadsafeQueue<std::string>;
+    // Faults in samples [offset, offset + count) of a mapped file, waiting
+    // for the disk if it has to. Does nothing for files in memory.
+    void pageIn(std::size_t offset, std::size_t count) const {
+        if (mMappedFile) {
+            mMappedFile->touch(mappedByteOffset(offset), count * mappedSampleBytes());
+        }
+    }
 
-class Logger {
-  public:
-    explicit Logger(MessageQueue &queue)
-        : mQueue{queue} {
+  private:
+    [[nodiscard]] std::size_t mappedSampleBytes() const {
+        return mMappedFormat == SampleFormat::Float32 ? 4 : 2;
     }
 
-    void log(std::string &&message) {
-        mQueue.push(std::forward<std::string>(message));
+    // Offset in the mapping of a sample.
+    [[nodiscard]] std::size_t mappedByteOffset(std::size_t sample) const {
+        return (mMappedSamples - mMappedFile->data()) + sample * mappedSampleBytes();
     }
 
-    // Wraps C++20 std::format utils and provides
-    // an interface compatible with that of libfmt.
-    template <typename... Args>
-    void logFmt(std::string_view fmt, Args &&...args) {
-        log(std::vformat(fmt, std::make_format_args(args...)));
+    // Maps the file and sets up the format if its samples can be used in place.
+    bool tryMap() {
+        std::optional<MappedFile> mapped = MappedFile::open(mPath);
+
+        if (!mapped) {
+            return false;
+        }
+
+        auto info = mapped_wav::parseHeader(mapped->data(), mapped->size());
+
+        if (!info) {
+            return false;
+        }
+
+        std::size_t sampleBytes = info->mFormat == SampleFormat::Float32 ? 4 : 2;
+
+        // The mapping is page-aligned, so this makes the samples naturally aligned.
+        if (info->mDataOffset % sampleBytes != 0) {
+            return false;
+        }
+
+        mMappedSamples = mapped->data() + info->mDataOffset;
+        mMappedFormat = info->mFormat;
+        mMappedFile = std::move(mapped);
+
+        mFormat.channels = info->mNumChannels;
+        mFormat.samplerate = info->mSampleRate;
+        mFormat.type = info->mFormat == SampleFormat::Float32 ? kfr::audio_sample_type::f32
+                                                              : kfr::audio_sample_type::i16;
+        mFormat.length = info->mDataBytes / (sampleBytes * info->mNumChannels);
+
+        return true;
     }
 
   private:
-    MessageQueue &mQueue;
+    std::string mPath;
+    LoadMode mLoadMode = LoadMode::Full;
+
+    kfr::univector<float> mData;
+    kfr::audio_format_and_length mFormat;
+
+    // Only set for mapped files.
+    std::optional<MappedFile> mMappedFile;
+    const std::byte *mMappedSamples = nullptr;
+    SampleFormat mMappedFormat = SampleFormat::Float32;
 };
 
 #endif // AUDIO_PLAYER_H
@@ -7,11 +7,15 @@
 
 #include "alsa_player.hpp"
 #include "audio_player.hpp"
+#include "filter.hpp"
 #include "processing_thread.hpp"
 #include "root_directory.h"
 #include "rt_queue.hpp"
+#include "spectrogram.hpp"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <optional>
@@ -60,13 +64,19 @@ enum class KeyEvent {
     KEY_q,
     KEY_s,
     KEY_b,
+    KEY_m,
+    KEY_n,
+    ARROW_LEFT,
+    ARROW_RIGHT,
+    ARROW_UP,
+    ARROW_DOWN,
     UNRECOGNIZED_KEY
 };
 
 struct AppState {
-    AppState(ProcQueue procQueue, MainQueue mainQueue)
-        : mPlaybackState(procQueue),
-          mProcThreadState(mainQueue, procQueue, mProcThreadRunning){};
+    AppState(TapBus &tap, SpectrumSnapshot &spectrum, RowQueue rowQueue)
+        : mPlaybackState(tap, mLogger),
+          mProcThreadState(spectrum, rowQueue, tap, mProcThreadRunning){};
 
     State mCurrentState = State::NoFile;
 
@@ -75,12 +85,18 @@ struct AppState {
     std::shared_ptr<const AudioFile> mAudioFile = nullptr;
 
     // playback thread state
+    alsa_player::PlaybackOptions mPlaybackOptions;
     std::atomic_bool mPlaybackInProgress = false;
     std::shared_ptr<std::thread> mPlaybackThread;
 
+    // Messages from the playback thread, formatted by the logger's drain thread.
     MessageQueue mQueue;
+    RtLogger mLogger{mQueue};
     SharedPlaybackState mPlaybackState;
 
+    // EQ band that the arrow keys adjust.
+    std::size_t mSelectedEqBand = 0;
+
     // processing thread state
     std::atomic_bool mProcThreadRunning = false;
     ProcessingThread mProcThreadState;
@@ -95,16 +111,24 @@ struct AppState {
 class PlaybackThread {
   public:
     explicit PlaybackThread(AppState &appState)
-        : mLogger(Logger{appState.mQueue}),
+        : mLogger(appState.mLogger),
           mPlaybackState(appState.mPlaybackState),
           mPlaybackInProgress(appState.mPlaybackInProgress),
-          mAudioFile(appState.mAudioFile) {
+          mAudioFile(appState.mAudioFile),
+          mPlaybackOptions(appState.mPlaybackOptions) {
     }
 
     void run() {
+        // Applied to this thread before anything else, so that
+        // memory allocated below is locked in real-time mode.
+        rt_thread::RtStatus rtStatus = rt_thread::makeRealTime(mPlaybackOptions.mRtOptions);
+        if (mPlaybackOptions.mRtOptions.mEnabled) {
+            mLogger.logText(rtStatus.mMessage);
+        }
+
         AlsaPlayer player{mPlaybackState};
 
-        if (!player.init(mAudioFile)) {
+        if (!player.init(mAudioFile, mPlaybackOptions)) {
             std::cerr << "AlsaPlayer init failed." << std::endl;
             // TODO: Better error handling.
         }
@@ -114,14 +138,16 @@ class PlaybackThread {
         }
 
         player.shutdown();
+        rt_thread::unlockMemory(rtStatus);
         mPlaybackInProgress = false;
     }
 
   private:
-    Logger mLogger;
+    RtLogger &mLogger;
     SharedPlaybackState &mPlaybackState;
     std::atomic_bool &mPlaybackInProgress;
     std::shared_ptr<const AudioFile> mAudioFile;
+    alsa_player::PlaybackOptions mPlaybackOptions;
 };
 
 // -------------
@@ -131,24 +157,54 @@ class PlaybackThread {
 // be agnostic to the specific UI implementation.
 
 class AudioPlayer {
-    DataQueue<alsa_player::PROCESSING_WINDOW_SIZE> mProcQueue;
-    DataQueue<proc_thread::NUM_SPECTROGRAM_BINS> mMainQueue;
+    // Filtered output from the playback thread; its doorbell wakes the processing thread.
+    TapBus mTap;
+    SpectrumSnapshot mSpectrumSnapshot;
+    RowQueue::queue_type mRowQueue;
 
     AppState mAppState;
     bool mRunning = true;
 
-    MainQueue::data_type spectrumBins{0};
+    proc_thread::SpectrumFrame spectrumFrame{};
+    SpectrogramHistory mSpectrogram;
 
   public:
     AudioPlayer()
-        : mProcQueue{QUEUE_CAP},
-          mMainQueue{QUEUE_CAP},
-          mAppState{QueueHolder{mProcQueue}, QueueHolder{mMainQueue}} {};
+        : mTap{alsa_player::TAP_CAPACITY},
+          mRowQueue{QUEUE_CAP},
+          mAppState{mTap, mSpectrumSnapshot, RowQueue{mRowQueue}} {};
 
     AppState &appState() {
         return mAppState;
     }
 
+    void setRtOptions(const rt_thread::RtOptions &options) {
+        mAppState.mPlaybackOptions.mRtOptions = options;
+    }
+
+    void setFftEngine(proc_thread::FftEngine engine) {
+        mAppState.mProcThreadState.setFftEngine(engine);
+    }
+
+    void setBandLayout(proc_thread::BandLayout layout) {
+        mAppState.mProcThreadState.setBandLayout(layout);
+    }
+
+    // Starts formatting messages from the playback thread. They are appended to
+    // the file if a path is given, and otherwise come from nextLogMessage().
+    bool startLogging(const std::string &filePath) {
+        return mAppState.mLogger.start(filePath);
+    }
+
+    // Returns the oldest message logged by the playback thread, if any.
+    std::optional<std::string> nextLogMessage() {
+        std::string message;
+        if (mAppState.mQueue.try_pop(message)) {
+            return message;
+        }
+        return std::nullopt;
+    }
+
     State currentState() const {
         return mAppState.mCurrentState;
     }
@@ -161,21 +217,47 @@ class AudioPlayer {
         return mRunning;
     }
 
-    const MainQueue::data_type::array_type &latestSpectrumData() {
-        if (mMainQueue.size() == 0) {
-            return spectrumBins.data;
+    // The latest playback state, all from the same period.
+    const PlaybackSnapshot &playbackSnapshot() {
+        TripleBuffer<PlaybackSnapshot> &snapshot = mAppState.mPlaybackState.mSnapshot;
+        snapshot.update();
+        return snapshot.front();
+    }
+
+    const proc_thread::SpectrumFrame &latestSpectrumData() {
+        while (const SpectrogramRow *row = mRowQueue.front()) {
+            mSpectrogram.addRow(*row);
+            mRowQueue.pop();
+        }
+
+        if (!mSpectrumSnapshot.update()) {
+            return spectrumFrame;
         }
-        // Discard older data and get the most recent.
-        while (mMainQueue.size() > 1) {
-            mMainQueue.pop();
+        const proc_thread::SpectrumFrame &latest = mSpectrumSnapshot.front();
+        if (latest.mLayout != spectrumFrame.mLayout ||
+            latest.mNumBands != spectrumFrame.mNumBands) {
+            spectrumFrame = latest;
         }
-        // Update moving average as with intensity level.
-        for (size_t bin = 0; bin < spectrumBins.data.size(); bin++) {
-            spectrumBins.data[bin] =
-                0.6 * spectrumBins.data[bin] + 0.4 * mMainQueue.front()->data[bin];
+        // Update moving average as with intensity level. Peaks are already smoothed.
+        for (size_t band = 0; band < latest.mNumBands; band++) {
+            spectrumFrame.mLevels[band] =
+                0.6f * spectrumFrame.mLevels[band] + 0.4f * latest.mLevels[band];
+            spectrumFrame.mLevelsDb[band] =
+                0.6f * spectrumFrame.mLevelsDb[band] + 0.4f * latest.mLevelsDb[band];
+            spectrumFrame.mPeaksDb[band] = latest.mPeaksDb[band];
         }
-        mMainQueue.pop();
-        return spectrumBins.data;
+        spectrumFrame.mTapOverruns = latest.mTapOverruns;
+        return spectrumFrame;
+    }
+
+    // Filled by latestSpectrumData().
+    uint64_t tapOverruns() const {
+        return spectrumFrame.mTapOverruns;
+    }
+
+    // Filled by latestSpectrumData(), so call that first.
+    const SpectrogramHistory &spectrogram() const {
+        return mSpectrogram;
     }
 
     bool loadAudioFile(std::optional<std::string> filePath) {
@@ -193,10 +275,11 @@ class AudioPlayer {
             mAppState.mFilepath = inFilename;
             mAppState.mCurrentState = State::Stopped;
 
-            // For now only support 44.1khz sample rate, until filter code is expanded.
-            if (mAppState.mAudioFile->sampleRate() != 44'100) {
-                throw std::runtime_error("Player currently only supports 44.1khz sample rate.");
+            if (mAppState.mAudioFile->channels() > IIRLowpassFilter::MAX_CHANNELS) {
+                throw std::runtime_error("Player supports at most 8 channels.");
             }
+            mAppState.mPlaybackState.mEqualizer.setSampleRate(
+                mAppState.mAudioFile->sampleRate());
 
             return true;
         } catch (const std::exception &e) {
@@ -230,6 +313,7 @@ class AudioPlayer {
         mAppState.mPlaybackInProgress = true;
 
         mAppState.mProcThreadState.setAudioSampleRate(mAppState.mAudioFile->sampleRate());
+        mAppState.mProcThreadState.setAudioChannels(mAppState.mAudioFile->channels());
         mAppState.mProcThreadRunning = true;
         mAppState.mProcessingThread = std::make_shared<std::thread>(mAppState.mProcThreadState);
 
@@ -284,6 +368,22 @@ class AudioPlayer {
             playAudioFile();
             break;
         }
+        case KeyEvent::KEY_m: {
+            // Toggle the access mode used for the next playback.
+            auto &accessMode = mAppState.mPlaybackOptions.mAccessMode;
+            accessMode = accessMode == alsa_player::AccessMode::ReadWrite
+                             ? alsa_player::AccessMode::Mmap
+                             : alsa_player::AccessMode::ReadWrite;
+            break;
+        }
+        case KeyEvent::KEY_n: {
+            // Toggle the wait mode used for the next playback.
+            auto &waitMode = mAppState.mPlaybackOptions.mWaitMode;
+            waitMode = waitMode == alsa_player::WaitMode::Blocking
+                           ? alsa_player::WaitMode::Poll
+                           : alsa_player::WaitMode::Blocking;
+            break;
+        }
         default: {
             handleEventGeneric(event);
             break;
@@ -294,14 +394,16 @@ class AudioPlayer {
     void handleEventPlaying(KeyEvent event) {
         switch (event) {
         case KeyEvent::KEY_s: {
-            mAppState.mPlaybackState.mPlaying = false;
+            mAppState.mPlaybackState.mControls.mPlaying.store(false, std::memory_order_relaxed);
+            mAppState.mPlaybackState.mControlEvent.notify();
             // TODO: Maybe add code to stop and resume thread.
             shutdownPlaybackThread();
-            resetPlaybackStates();
             break;
         }
         case KeyEvent::KEY_b: {
-            mAppState.mPlaybackState.mBoost = !mAppState.mPlaybackState.mBoost;
+            std::atomic_bool &boost = mAppState.mPlaybackState.mControls.mBoost;
+            boost.store(!boost.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            mAppState.mPlaybackState.mControlEvent.notify();
             break;
         }
         default: {
@@ -315,12 +417,34 @@ class AudioPlayer {
         switch (event) {
         case KeyEvent::KEY_q: {
             if (currentState() == State::Playing) {
-                mAppState.mPlaybackState.mPlaying = false;
+                SharedPlaybackState &playbackState = mAppState.mPlaybackState;
+                playbackState.mControls.mPlaying.store(false, std::memory_order_relaxed);
+                playbackState.mControlEvent.notify();
                 shutdownPlaybackThread();
             }
             mRunning = false;
             break;
         }
+        case KeyEvent::ARROW_LEFT:
+        case KeyEvent::ARROW_RIGHT: {
+            std::size_t &band = mAppState.mSelectedEqBand;
+            if (event == KeyEvent::ARROW_LEFT) {
+                band = band > 0 ? band - 1 : 0;
+            } else {
+                band = std::min(band + 1, equalizer::NUM_BANDS - 1);
+            }
+            break;
+        }
+        case KeyEvent::ARROW_UP:
+        case KeyEvent::ARROW_DOWN: {
+            // The new coefficients are designed here, on the UI thread.
+            EqualizerControls &eq = mAppState.mPlaybackState.mEqualizer;
+            std::size_t band = mAppState.mSelectedEqBand;
+            float step = event == KeyEvent::ARROW_UP ? equalizer::GAIN_STEP_DB
+                                                     : -equalizer::GAIN_STEP_DB;
+            eq.setGainDb(band, eq.gainDb(band) + step);
+            break;
+        }
         default: {
             // Key event not handled in current state.
             break;
@@ -345,18 +469,19 @@ class AudioPlayer {
     void shutdownPlaybackThread() {
         mAppState.mPlaybackThread->join();
         mAppState.mPlaybackThread = nullptr;
+
+        // Adjust the latency for the next playback based on how this one went.
+        mAppState.mPlaybackOptions.mLatencyController.update(
+            playbackSnapshot().mStats,
+            mAppState.mPlaybackState.mDevice.mPeriodTimeUs.load(std::memory_order_relaxed));
+
         mAppState.mProcThreadRunning = false;
+        mTap.doorbell().ringAll();
         mAppState.mProcessingThread->join();
         mAppState.mProcessingThread = nullptr;
         mAppState.mCurrentState = State::Stopped;
     }
 
-    void resetPlaybackStates() {
-        mAppState.mPlaybackState.mAvgIntensity = 0.0;
-        mAppState.mPlaybackState.mNumTicks = 0;
-        mAppState.mPlaybackState.mTickNum = 0;
-    }
-
   private:
     using KeyHandler = decltype(&AudioPlayer::handleEventGeneric);
     static std::map<State, KeyHandler> sKeyHandlers;
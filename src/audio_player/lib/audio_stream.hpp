@@ -0,0 +1,223 @@
+// Chunked access to an AudioFile's samples for the playback loop.
+//
+// For streaming files a background reader thread decodes the file into
+// a small ring of fixed-size chunks, so memory use does not depend on
+// the length of the file and playback can start after the first chunk.
+// Mapped files go through the same ring: the reader faults each chunk
+// of the mapping in ahead of playback, so the playback loop only ever
+// reads resident pages. Mapped float chunks are spans into the mapping,
+// and mapped int16 ones are converted into the ring. For fully-loaded
+// files chunks are just spans into the file's data.
+
+#ifndef AUDIO_STREAM_H_
+#define AUDIO_STREAM_H_
+
+#include "audio_player.hpp"
+#include "doorbell.hpp"
+
+#include <kfr/io.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace audio_stream {
+
+// Must be a power of two so the chunk counters below can wrap around.
+static constexpr std::size_t NUM_CHUNKS = 4;
+
+// Approximate chunk size. The actual size is rounded to a multiple
+// of the ALSA period size so that periods never straddle chunks.
+static constexpr std::size_t TARGET_CHUNK_FRAMES = 8192;
+
+} // namespace audio_stream
+
+class AudioStream {
+    static_assert((audio_stream::NUM_CHUNKS & (audio_stream::NUM_CHUNKS - 1)) == 0);
+
+  public:
+    AudioStream(std::shared_ptr<const AudioFile> file, std::size_t framesPerPeriod)
+        : mFile(std::move(file)),
+          mNumChannels(mFile->channels()),
+          mInMemory(mFile->loadMode() == AudioFile::LoadMode::Full) {
+        std::size_t periods = std::max<std::size_t>(
+            1, audio_stream::TARGET_CHUNK_FRAMES / std::max<std::size_t>(1, framesPerPeriod));
+        mChunkSamples = periods * framesPerPeriod * mNumChannels;
+
+        if (mFile->isStreaming()) {
+            mRing.resize(audio_stream::NUM_CHUNKS * mChunkSamples, 0.0f);
+        }
+    }
+
+    ~AudioStream() {
+        stop();
+    }
+
+    AudioStream(const AudioStream &) = delete;
+    AudioStream &operator=(const AudioStream &) = delete;
+
+    // Starts the reader thread for streaming and mapped files.
+    void start() {
+        if (!mInMemory && !mReaderThread.joinable()) {
+            mReaderThread = std::thread([this]() { readerLoop(); });
+        }
+    }
+
+    // Stops and joins the reader thread. Safe to call more than once.
+    void stop() {
+        mStopReader = true;
+        // Wake a reader blocked on a full ring so it sees the flag. The ring
+        // counters are left alone, so no slot is handed back early.
+        mReaderDoorbell.ring();
+
+        if (mReaderThread.joinable()) {
+            mReaderThread.join();
+        }
+    }
+
+    [[nodiscard]] std::size_t chunkSamples() const {
+        return mChunkSamples;
+    }
+
+    // Returns the next chunk of interleaved samples, or an empty span at the end of
+    // the file. Waits for the reader only if it has fallen behind the playback loop,
+    // which should not happen in steady state. Call release() when done with a chunk.
+    std::span<const float> acquire() {
+        if (mInMemory) {
+            std::size_t remaining = mFile->dataLength() - mFilePosition;
+            return {mFile->data() + mFilePosition, std::min(remaining, mChunkSamples)};
+        }
+
+        uint32_t readCount = mReadCount.load(std::memory_order_relaxed);
+        uint32_t writeCount = mWriteCount.load(std::memory_order_acquire);
+
+        while (writeCount == readCount) {
+            mWriteCount.wait(writeCount, std::memory_order_acquire);
+            writeCount = mWriteCount.load(std::memory_order_acquire);
+        }
+
+        std::size_t slot = readCount % audio_stream::NUM_CHUNKS;
+        return {mChunkData[slot], mChunkLengths[slot]};
+    }
+
+    // Returns the chunk most recently acquired to the reader.
+    void release() {
+        if (mInMemory) {
+            mFilePosition = std::min(mFilePosition + mChunkSamples, mFile->dataLength());
+            return;
+        }
+
+        mReadCount.fetch_add(1, std::memory_order_release);
+        mReaderDoorbell.ring();
+    }
+
+  private:
+    void readerLoop() {
+        std::unique_ptr<kfr::audio_reader_wav<float>> reader;
+        // Only one of these is set for a mapped file.
+        const float *floatData = mFile->data();
+        const int16_t *int16Data = mFile->mappedInt16Data();
+        const bool isMapped = floatData != nullptr || int16Data != nullptr;
+        std::size_t mappedPosition = 0;
+
+        if (!isMapped) {
+            if (auto file = kfr::open_file_for_reading(mFile->path()); file != nullptr) {
+                reader = std::make_unique<kfr::audio_reader_wav<float>>(file);
+            }
+        }
+
+        bool endOfFile = reader == nullptr && !isMapped;
+
+        while (true) {
+            // Read before checking, so a release() or stop() after this wakes the wait below.
+            uint32_t seenSequence = mReaderDoorbell.sequence();
+            if (mStopReader) {
+                break;
+            }
+            uint32_t writeCount = mWriteCount.load(std::memory_order_relaxed);
+            uint32_t readCount = mReadCount.load(std::memory_order_acquire);
+
+            // Wait for the playback loop to free a slot.
+            if (writeCount - readCount >= audio_stream::NUM_CHUNKS) {
+                mReaderDoorbell.wait(seenSequence);
+                continue;
+            }
+
+            std::size_t slot = writeCount % audio_stream::NUM_CHUNKS;
+            // Mapped float files have no ring.
+            float *ringChunk = mRing.empty() ? nullptr : mRing.data() + slot * mChunkSamples;
+            std::size_t samplesRead = 0;
+            mChunkData[slot] = ringChunk;
+
+            if (!endOfFile && isMapped) {
+                samplesRead = std::min(mChunkSamples, mFile->dataLength() - mappedPosition);
+                // Start the disk on the chunk after this one while this one is faulted
+                // in, here rather than on the playback thread.
+                mFile->prefetch(mappedPosition + samplesRead, mChunkSamples);
+
+                if (floatData != nullptr) {
+                    mFile->pageIn(mappedPosition, samplesRead);
+                    mChunkData[slot] = floatData + mappedPosition;
+                } else {
+                    convertInt16(int16Data + mappedPosition, ringChunk, samplesRead);
+                }
+                mappedPosition += samplesRead;
+            } else if (!endOfFile) {
+                samplesRead = reader->read(ringChunk, mChunkSamples);
+                // Keep chunks whole frames in case the file ends mid-frame.
+                samplesRead -= samplesRead % mNumChannels;
+            }
+            mChunkLengths[slot] = samplesRead;
+
+            mWriteCount.store(writeCount + 1, std::memory_order_release);
+            mWriteCount.notify_one();
+
+            // An empty chunk tells the playback loop the file is done.
+            if (samplesRead == 0) {
+                break;
+            }
+            endOfFile = samplesRead < mChunkSamples;
+        }
+    }
+
+    static void convertInt16(const int16_t *in, float *out, std::size_t count) {
+        constexpr float SCALE = 1.0f / 32768.0f;
+        for (std::size_t i = 0; i < count; i++) {
+            out[i] = static_cast<float>(in[i]) * SCALE;
+        }
+    }
+
+  private:
+    std::shared_ptr<const AudioFile> mFile;
+    std::size_t mNumChannels = 1;
+    std::size_t mChunkSamples = 0;
+    // Fully-loaded files are read directly, without the reader thread.
+    bool mInMemory = false;
+
+    // Read position for fully-loaded files.
+    std::size_t mFilePosition = 0;
+
+    // Ring of chunks handed from the reader to the playback loop. Decoded and
+    // converted chunks live in mRing, and mapped float ones in the mapping.
+    std::vector<float> mRing;
+    std::array<const float *, audio_stream::NUM_CHUNKS> mChunkData{};
+    std::array<std::size_t, audio_stream::NUM_CHUNKS> mChunkLengths{};
+
+    // Number of chunks produced and consumed. These are 32 bits
+    // so that waiting and notifying on them can use a futex.
+    std::atomic<uint32_t> mWriteCount = 0;
+    std::atomic<uint32_t> mReadCount = 0;
+
+    std::atomic_bool mStopReader = false;
+    // Rung when a slot is freed or the reader should stop.
+    Doorbell mReaderDoorbell;
+    std::thread mReaderThread;
+};
+
+#endif // AUDIO_STREAM_H_
@@ -8,9 +8,13 @@
 #include "audio_player_app.hpp"
 #include "curses_console.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <fmt/format.h>
+#include <span>
 #include <string>
 
 using ColorPair = CursesConsole::ColorPair;
@@ -37,17 +41,78 @@ class ConsoleManager {
         }
         incCurrentLine(1);
 
+        const SharedPlaybackState &playbackState = mAudioPlayer.appState().mPlaybackState;
+        const SharedPlaybackState::DeviceInfo &device = playbackState.mDevice;
+
         if (mAudioPlayer.currentState() == State::Playing) {
+            const PlaybackSnapshot &snapshot = mAudioPlayer.playbackSnapshot();
             mConsole.addString("File is playing.");
-            if (mAudioPlayer.appState().mPlaybackState.mBoost) {
+            if (playbackState.mControls.mBoost.load(std::memory_order_relaxed)) {
                 mConsole.addString(" -- [");
                 mConsole.addStringWithColor("Boost is active.", ColorPair::YellowOnBlack);
                 mConsole.addString("]");
             }
             incCurrentLine(1);
+            auto waitMode = mAudioPlayer.appState().mPlaybackOptions.mWaitMode;
+            mConsole.addString(
+                fmt::format("Access mode: {}, wait mode: {} ({:.1f} us CPU / period)",
+                            alsa_player::accessModeString(device.mAccessMode.load()),
+                            alsa_player::waitModeString(waitMode),
+                            snapshot.mPeriodCpuUs));
+            incCurrentLine(1);
+            showPlaybackStats(snapshot.mStats);
+            mConsole.addString(fmt::format("Buffer: {} frames, period: {} frames ({} us)",
+                                           device.mBufferFrames.load(),
+                                           device.mPeriodFrames.load(),
+                                           device.mPeriodTimeUs.load()));
+            incCurrentLine(1);
+            const ProcessingThread &procThread = mAudioPlayer.appState().mProcThreadState;
+            mConsole.addString(fmt::format("Spectrum engine: {}, {}-point FFT, tap overruns: {}",
+                                           proc_thread::fftEngineString(procThread.fftEngine()),
+                                           procThread.fftSize(), mAudioPlayer.tapOverruns()));
+            incCurrentLine(1);
         } else if (mAudioPlayer.currentState() == State::Stopped) {
+            const auto &options = mAudioPlayer.appState().mPlaybackOptions;
+            mConsole.addString(fmt::format("Access mode: {}, wait mode: {}",
+                                           alsa_player::accessModeString(options.mAccessMode),
+                                           alsa_player::waitModeString(options.mWaitMode)));
+            incCurrentLine(1);
+            mConsole.addString(fmt::format("Target latency: {:.1f} ms",
+                                           options.mLatencyController.latencyUs() / 1000.0));
             incCurrentLine(1);
         }
+        if (mAudioPlayer.fileIsLoaded()) {
+            showEqualizer(playbackState.mEqualizer, mAudioPlayer.appState().mSelectedEqBand);
+        }
+        incCurrentLine(1);
+    }
+
+    // Band centers over their gains, with the selected band highlighted.
+    void showEqualizer(const EqualizerControls &eq, std::size_t selectedBand) {
+        constexpr int COLUMN_WIDTH = 6;
+
+        clearLine();
+        mConsole.moveCursor(0, mCurrentLine);
+        mConsole.addString("EQ Hz:");
+        for (float frequency : equalizer::BAND_FREQUENCIES) {
+            mConsole.addString(frequency < 1000.0f
+                                   ? fmt::format("{:>{}.0f}", frequency, COLUMN_WIDTH)
+                                   : fmt::format("{:>{}.0f}k", frequency / 1000.0f,
+                                                 COLUMN_WIDTH - 1));
+        }
+        incCurrentLine(1);
+
+        clearLine();
+        mConsole.moveCursor(0, mCurrentLine);
+        mConsole.addString("   dB:");
+        for (std::size_t band = 0; band < equalizer::NUM_BANDS; band++) {
+            auto gain = fmt::format("{:>+{}.0f}", eq.gainDb(band), COLUMN_WIDTH);
+            if (band == selectedBand) {
+                mConsole.addStringWithColor(gain, ColorPair::YellowOnBlack);
+            } else {
+                mConsole.addString(gain);
+            }
+        }
         incCurrentLine(1);
     }
 
@@ -82,6 +147,10 @@ class ConsoleManager {
         case State::Stopped: {
             mConsole.addString("Press p to play file.");
             incCurrentLine(1);
+            mConsole.addString("Press m to toggle mmap access, n to toggle poll wait mode.");
+            incCurrentLine(1);
+            mConsole.addString("Use left/right to pick an EQ band, up/down to change its gain.");
+            incCurrentLine(1);
             break;
 
             // TODO: Add option to change file.
@@ -91,6 +160,8 @@ class ConsoleManager {
             incCurrentLine(1);
             mConsole.addString("Press b to toggle boost.");
             incCurrentLine(1);
+            mConsole.addString("Use left/right to pick an EQ band, up/down to change its gain.");
+            incCurrentLine(1);
             break;
         }
         default: {
@@ -127,11 +198,26 @@ class ConsoleManager {
     }
 
     void clearLine() {
+        clearLine(mCurrentLine);
+    }
+
+    void clearLine(int line) {
         int screenWidth = mConsole.getScreenSize().second;
-        mConsole.moveCursor(0, mCurrentLine);
+        mConsole.moveCursor(0, line);
         mConsole.addString(std::string(screenWidth, ' '));
     }
 
+    void showPlaybackStats(const PlaybackStatsSnapshot &stats) {
+        auto line = fmt::format("Xruns: {}, worst period: {:.1f} us, delay: {} frames (min {})",
+                                stats.mXruns, stats.mWorstPeriodNs / 1000.0, stats.mDelayFrames,
+                                stats.mMinDelayFrames);
+        clearLine();
+        mConsole.moveCursor(0, mCurrentLine);
+        mConsole.addStringWithColor(line, stats.mXruns > 0 ? ColorPair::RedOnBlack
+                                                           : ColorPair::WhiteOnBlack);
+        incCurrentLine(1);
+    }
+
     void showSoundLevel(float intensity) {
         int intensityLevel = 1 + static_cast<int>(std::round(intensity));
         int greenParts = std::min(intensityLevel - 1, 15);
@@ -149,9 +235,17 @@ class ConsoleManager {
         incCurrentLine(2);
     }
 
-    template <size_t N>
-    void showSpectrumBinLevels(const std::array<float, N> &bins) {
-        auto label = [](size_t bin) -> const char * {
+    void showSpectrum(const proc_thread::SpectrumFrame &frame) {
+        if (frame.mLayout == proc_thread::BandLayout::Octave) {
+            showSpectrumBinLevels(std::span{frame.mLevels.data(), frame.mNumBands});
+        } else {
+            showSpectrumAnalyzer(frame);
+        }
+    }
+
+    void showSpectrumBinLevels(std::span<const float> bins) {
+        const size_t N = bins.size();
+        auto label = [N](size_t bin) -> const char * {
             if (bin == 0) {
                 return "L: ";
             } else if (bin == N - 1) {
@@ -183,6 +277,103 @@ class ConsoleManager {
         incCurrentLine(1);
     }
 
+    // Fractional octave bands as columns of bars, one or two characters wide,
+    // with the held peak of each band marked above its bar.
+    void showSpectrumAnalyzer(const proc_thread::SpectrumFrame &frame) {
+        constexpr int NUM_ROWS = 12;
+        constexpr float DB_PER_ROW = 6.0f;
+        // Rows at or above these levels are drawn yellow and red.
+        constexpr float YELLOW_DB = -24.0f;
+        constexpr float RED_DB = -6.0f;
+        constexpr int LABEL_WIDTH = 5;
+
+        const size_t numBands = frame.mNumBands;
+        const int columnWidth = numBands <= proc_thread::MAX_BANDS / 2 ? 2 : 1;
+
+        // Number of rows a level fills, rounding up so any signal above the
+        // bottom row shows.
+        auto rowsFor = [=](float db) {
+            return std::clamp(static_cast<int>(std::ceil(NUM_ROWS + db / DB_PER_ROW)), 0,
+                              NUM_ROWS);
+        };
+
+        for (int row = NUM_ROWS; row >= 1; row--) {
+            float rowDb = -DB_PER_ROW * static_cast<float>(NUM_ROWS - row);
+            ColorPair color = rowDb >= RED_DB      ? ColorPair::RedOnBlack
+                              : rowDb >= YELLOW_DB ? ColorPair::YellowOnBlack
+                                                   : ColorPair::GreenOnBlack;
+            clearLine();
+            mConsole.moveCursor(0, mCurrentLine);
+            mConsole.addString(row % 2 == 0 ? fmt::format("{:>4.0f} ", rowDb)
+                                            : std::string(LABEL_WIDTH, ' '));
+
+            for (size_t band = 0; band < numBands; band++) {
+                bool filled = rowsFor(frame.mLevelsDb[band]) >= row;
+                bool peak = !filled && rowsFor(frame.mPeaksDb[band]) == row;
+                if (filled) {
+                    mConsole.addStringWithColor(std::string(columnWidth, '|'), color);
+                } else if (peak) {
+                    mConsole.addStringWithColor(std::string(columnWidth, '-'),
+                                                ColorPair::WhiteOnBlack);
+                } else {
+                    mConsole.addString(std::string(columnWidth, ' '));
+                }
+            }
+            incCurrentLine(1);
+        }
+
+        // Mark the bands nearest each decade.
+        clearLine();
+        mConsole.moveCursor(0, mCurrentLine);
+        mConsole.addString(std::string(LABEL_WIDTH, ' '));
+        proc_thread::BandEdges edges = mAudioPlayer.appState().mProcThreadState.bandEdges();
+        std::string labels(numBands * columnWidth, ' ');
+        for (double decade : {100.0, 1'000.0, 10'000.0}) {
+            for (size_t band = 0; band < numBands; band++) {
+                if (edges.mEdges[band] <= decade && decade < edges.mEdges[band + 1]) {
+                    auto text = decade < 1000.0 ? fmt::format("{:.0f}", decade)
+                                                : fmt::format("{:.0f}k", decade / 1000.0);
+                    labels.replace(band * columnWidth, text.size(), text);
+                }
+            }
+        }
+        mConsole.addString(labels);
+        incCurrentLine(1);
+        // The double engine's levels vary with frequency; see its FULL_SCALE_LEVEL.
+        bool calibrated = mAudioPlayer.appState().mProcThreadState.fftEngine() ==
+                          proc_thread::FftEngine::Float;
+        mConsole.addString(fmt::format("{} bands, dB re full-scale sine{}",
+                                       proc_thread::bandLayoutString(frame.mLayout),
+                                       calibrated ? "" : " (uncalibrated)"));
+        incCurrentLine(2);
+    }
+
+    // Spectrogram rows, newest at the top, shaded by level. Only rows added since
+    // the last call are drawn; the older ones are scrolled down on the terminal.
+    void showWaterfall(const SpectrogramHistory &history) {
+        const int top = mCurrentLine;
+        const int bottom = top + WATERFALL_ROWS - 1;
+        const uint64_t newRows = history.totalRows() - mWaterfallDrawnRows;
+
+        bool redrawAll = top != mWaterfallTop || mConsole.clearCount() != mWaterfallClears ||
+                         newRows >= static_cast<uint64_t>(WATERFALL_ROWS);
+        if (redrawAll) {
+            for (int line = 0; line < WATERFALL_ROWS; line++) {
+                drawWaterfallRow(history, static_cast<size_t>(line), top + line);
+            }
+        } else if (newRows > 0) {
+            mConsole.scrollLines(top, bottom, static_cast<int>(newRows));
+            for (int line = 0; line < static_cast<int>(newRows); line++) {
+                drawWaterfallRow(history, static_cast<size_t>(line), top + line);
+            }
+        }
+
+        mWaterfallTop = top;
+        mWaterfallClears = mConsole.clearCount();
+        mWaterfallDrawnRows = history.totalRows();
+        incCurrentLine(WATERFALL_ROWS + 1);
+    }
+
     void showTimeBar(float propDone) {
         constexpr int BAR_WIDTH = 41;
 
@@ -225,6 +416,24 @@ class ConsoleManager {
         case CURSES_KEY_b: {
             return KeyEvent::KEY_b;
         }
+        case CURSES_KEY_m: {
+            return KeyEvent::KEY_m;
+        }
+        case CURSES_KEY_n: {
+            return KeyEvent::KEY_n;
+        }
+        case KEY_LEFT: {
+            return KeyEvent::ARROW_LEFT;
+        }
+        case KEY_RIGHT: {
+            return KeyEvent::ARROW_RIGHT;
+        }
+        case KEY_UP: {
+            return KeyEvent::ARROW_UP;
+        }
+        case KEY_DOWN: {
+            return KeyEvent::ARROW_DOWN;
+        }
         default: {
             return KeyEvent::UNRECOGNIZED_KEY;
         }
@@ -237,12 +446,53 @@ class ConsoleManager {
         mConsole.moveCursor(0, mCurrentLine);
     }
 
+    // Draws the row of the given age on a screen line, or a blank line if
+    // there is no row that old yet.
+    void drawWaterfallRow(const SpectrogramHistory &history, size_t age, int line) {
+        // Shades from quietest to loudest, and the level each one starts at.
+        constexpr std::array<char, 5> SHADES = {'.', ':', '+', '#', '@'};
+        constexpr std::array<float, 5> SHADE_DB = {-72.0f, -54.0f, -36.0f, -18.0f, -6.0f};
+        constexpr std::array<ColorPair, 5> SHADE_COLORS = {
+            ColorPair::BlueOnBlack,   ColorPair::BlueOnBlack, ColorPair::GreenOnBlack,
+            ColorPair::YellowOnBlack, ColorPair::RedOnBlack,
+        };
+
+        clearLine(line);
+        mConsole.moveCursor(0, line);
+        if (age >= history.size()) {
+            return;
+        }
+        const SpectrogramRow &row = history.row(age);
+        const int columnWidth = row.mNumBands <= proc_thread::MAX_BANDS / 2 ? 2 : 1;
+
+        mConsole.addString(std::string(WATERFALL_LABEL_WIDTH, ' '));
+        for (size_t band = 0; band < row.mNumBands; band++) {
+            float levelDb = row.mLevelsDb[band];
+            auto shade = std::upper_bound(SHADE_DB.begin(), SHADE_DB.end(), levelDb) -
+                         SHADE_DB.begin() - 1;
+            if (shade < 0) {
+                mConsole.addString(std::string(columnWidth, ' '));
+            } else {
+                mConsole.addStringWithColor(std::string(columnWidth, SHADES[shade]),
+                                            SHADE_COLORS[shade]);
+            }
+        }
+    }
+
+    static constexpr int WATERFALL_ROWS = 16;
+    static constexpr int WATERFALL_LABEL_WIDTH = 5;
+
   private:
     CursesConsole &mConsole;
     AudioPlayer &mAudioPlayer;
 
     int mCurrentLine = 0;
     std::string mEndNote;
+
+    // What the waterfall view last drew, so it can draw just the new rows.
+    int mWaterfallTop = -1;
+    uint64_t mWaterfallClears = 0;
+    uint64_t mWaterfallDrawnRows = 0;
 };
 
 #endif // CONSOLE_MANAGER_H
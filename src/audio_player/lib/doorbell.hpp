@@ -0,0 +1,66 @@
+// Lets a consumer thread sleep until a producer has something for it,
+// without the producer ever blocking.
+//
+// The consumer spins briefly, which catches data that arrives right away
+// without a syscall, and then parks on std::atomic::wait, which is a futex
+// on Linux. The producer bumps a counter and calls notify_one, which only
+// makes a syscall when someone is actually parked.
+
+#ifndef DOORBELL_H_
+#define DOORBELL_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace doorbell {
+
+// About a few microseconds of spinning before parking.
+static constexpr int SPIN_ITERATIONS = 2000;
+
+// Tells the CPU we are spinning, which saves power and
+// lets a hyperthread sibling use the core.
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace doorbell
+
+class Doorbell {
+  public:
+    // Producer side; safe to call from the real-time thread.
+    void ring() {
+        mSequence.fetch_add(1, std::memory_order_release);
+        mSequence.notify_one();
+    }
+
+    // Like ring(), but wakes every waiting consumer.
+    void ringAll() {
+        mSequence.fetch_add(1, std::memory_order_release);
+        mSequence.notify_all();
+    }
+
+    // Consumer side. Read this before checking for work, and pass it to wait() if
+    // there was none. A ring() after the read then makes wait() return right away.
+    [[nodiscard]] uint32_t sequence() const {
+        return mSequence.load(std::memory_order_acquire);
+    }
+
+    void wait(uint32_t seenSequence) const {
+        for (int i = 0; i < doorbell::SPIN_ITERATIONS; i++) {
+            if (mSequence.load(std::memory_order_acquire) != seenSequence) {
+                return;
+            }
+            doorbell::cpuRelax();
+        }
+        mSequence.wait(seenSequence, std::memory_order_acquire);
+    }
+
+  private:
+    std::atomic<uint32_t> mSequence = 0;
+};
+
+#endif // DOORBELL_H_
@@ -0,0 +1,49 @@
+// A Linux eventfd, used to wake a thread that is blocked in poll().
+
+#ifndef EVENT_FD_H_
+#define EVENT_FD_H_
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <stdexcept>
+
+class EventFd {
+  public:
+    EventFd() {
+        mFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (mFd < 0) {
+            throw std::runtime_error("Failed to create eventfd.");
+        }
+    }
+
+    ~EventFd() {
+        close(mFd);
+    }
+
+    EventFd(const EventFd &) = delete;
+    EventFd &operator=(const EventFd &) = delete;
+
+    [[nodiscard]] int fd() const {
+        return mFd;
+    }
+
+    // Makes the fd readable. Never blocks, since the counter can't realistically overflow.
+    void notify() const {
+        uint64_t one = 1;
+        ssize_t _ = write(mFd, &one, sizeof(one));
+    }
+
+    // Resets the fd to not readable.
+    void drain() const {
+        uint64_t count;
+        ssize_t _ = read(mFd, &count, sizeof(count));
+    }
+
+  private:
+    int mFd = -1;
+};
+
+#endif // EVENT_FD_H_
@@ -1,126 +1,126 @@
 #ifndef FILTER_H_
 #define FILTER_H_
 
+#include <dsp/biquad.hpp>
+#include <dsp/filter_design.hpp>
+#include <dsp/param_ramp.hpp>
+
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
-#include <cstdint>
-
-#define MUST_INLINE __attribute__((always_inline)) inline
 
-// Initial implementation of IIR lowpass filter.
-// Can be generalized and optimized more later.
+// IIR lowpass filter used for the bass boost, evaluated as a cascade
+// of second-order sections with the channels of each frame in SIMD lanes.
 
 class IIRLowpassFilter {
-    // Coefficents of transfer function num / denom polynomials.
+    // Butterworth lowpass, with the cutoff where the old elliptic design from
+    // scripts/design_filters.py had its passband edge. Order 5 gives the same
+    // three sections, the first of which is really first order.
 
-    // Number of a / b coefficents. (Here the same # for each.)
-    static constexpr uint64_t FILTER_SIZE = 6;
+    static constexpr size_t ORDER = 5;
+    static constexpr size_t NUM_SECTIONS = (ORDER + 1) / 2;
+    static constexpr double CUTOFF_HZ = 1000.0;
 
-    // clang-format off
-    static constexpr double mBCoeffs[FILTER_SIZE] = {0.00319064, -0.00927144,  0.00608712,  0.00608712, -0.00927144, 0.00319064};
-    static constexpr double mACoeffs[FILTER_SIZE] = {1.        , -4.84007379,  9.40031811, -9.1568206 ,  4.4733176 , -0.87672867};
-    // clang-format on
+    using SectionFilter = dsp::SosFilter<NUM_SECTIONS>;
+    using Sections = SectionFilter::Sections;
 
-    // Circular buffers to hold previous input / output values.
-    //
-    //  We store previous input values to simplify use and initialization.
+    // Designs for common sample rates are made at compile time.
+    static constexpr std::array<unsigned int, 3> PRECOMPUTED_RATES = {44'100, 48'000, 96'000};
 
-    static constexpr uint64_t BUFFER_LEN = 32;
+    static constexpr std::array<Sections, PRECOMPUTED_RATES.size()> PRECOMPUTED_SECTIONS = [] {
+        std::array<Sections, PRECOMPUTED_RATES.size()> designs{};
+        for (size_t i = 0; i < PRECOMPUTED_RATES.size(); i++) {
+            designs[i] = dsp::butterworthLowpass<ORDER>(PRECOMPUTED_RATES[i], CUTOFF_HZ);
+        }
+        return designs;
+    }();
 
-    // Left channel data.
-    double mPrevInputsL[BUFFER_LEN] = {0.0f};
-    double mPrevOutputsL[BUFFER_LEN] = {0.0f};
+    static Sections designSections(unsigned int sampleRate) {
+        for (size_t i = 0; i < PRECOMPUTED_RATES.size(); i++) {
+            if (PRECOMPUTED_RATES[i] == sampleRate) {
+                return PRECOMPUTED_SECTIONS[i];
+            }
+        }
+        return dsp::butterworthLowpass<ORDER>(sampleRate, CUTOFF_HZ);
+    }
 
-    // Right channel data.
-    double mPrevInputsR[BUFFER_LEN] = {0.0f};
-    double mPrevOutputsR[BUFFER_LEN] = {0.0f};
+    SectionFilter mFilter;
 
-    // Pointer to last element written in buffers.
-    uint64_t mLastIoIdxL = FILTER_SIZE - 1;
-    uint64_t mLastIoIdxR = FILTER_SIZE - 1;
+    // Long enough to avoid a click, short enough to feel immediate.
+    static constexpr float MIX_RAMP_SECONDS = 0.01f;
+    dsp::ParamRamp mMix;
 
     // User-supplied parameters.
 
     // Size of write buffer outgoing to audio device.
     size_t mWriteBufferSize = 0;
-    // If == 2 then in/out buffers are interleaved.
+    // If > 1 then in/out buffers are interleaved.
     size_t mNChannels = 1;
 
   public:
-    IIRLowpassFilter(size_t mWriteBufferSize, size_t nChannels)
-        : mWriteBufferSize(mWriteBufferSize),
-          mNChannels(nChannels) {
-    }
-
-    void fillBuffer(const float *inBuffer, float *outBuffer, const float mix) {
-        for (size_t i = 0; i < mWriteBufferSize / mNChannels; i++) {
-            const float *lInPtr = inBuffer + (mNChannels * i);
-            float *lOutPtr = outBuffer + (mNChannels * i);
-
-            double next = getNextL(*lInPtr);
-            setIOL(*lInPtr, next);
-            assert(!std::isnan(next));
-
-            *lOutPtr = mix * next + *lInPtr;
-
-            if (mNChannels == 2) {
-                const float *rInPtr = lInPtr + 1;
-                float *rOutPtr = lOutPtr + 1;
-
-                next = getNextR(*rInPtr);
-                setIOR(*rInPtr, next);
-                assert(!std::isnan(next));
+    // Channels are filtered in SIMD lanes, so this is the lane count.
+    static constexpr size_t MAX_CHANNELS = SectionFilter::MAX_CHANNELS;
 
-                *rOutPtr = mix * next + *rInPtr;
-            }
-        }
+    IIRLowpassFilter(size_t mWriteBufferSize, size_t nChannels, unsigned int sampleRate)
+        : mFilter(designSections(sampleRate)),
+          mMix(0.0f, static_cast<size_t>(MIX_RAMP_SECONDS * sampleRate)),
+          mWriteBufferSize(mWriteBufferSize),
+          mNChannels(nChannels) {
+        assert(nChannels >= 1 && nChannels <= MAX_CHANNELS);
     }
 
-  private:
-    // offset: Offset from current sample number.
-    MUST_INLINE double getIL(int64_t offset) {
-        return mPrevInputsL[(mLastIoIdxL + BUFFER_LEN - (offset - 1)) % BUFFER_LEN];
-    }
-    MUST_INLINE double getOL(int64_t offset) {
-        return mPrevOutputsL[(mLastIoIdxL + BUFFER_LEN - (offset - 1)) % BUFFER_LEN];
+    // Blend of filtered signal added to the input. Changes are ramped in
+    // over the next MIX_RAMP_SECONDS, so toggling the boost doesn't click.
+    void setMix(float mix) {
+        mMix.setTarget(mix);
     }
 
-    MUST_INLINE double getIR(int64_t offset) {
-        return mPrevInputsR[(mLastIoIdxR + BUFFER_LEN - (offset - 1)) % BUFFER_LEN];
-    }
-    MUST_INLINE double getOR(int64_t offset) {
-        return mPrevOutputsR[(mLastIoIdxR + BUFFER_LEN - (offset - 1)) % BUFFER_LEN];
+    void fillBuffer(const float *inBuffer, float *outBuffer) {
+        fillFrames(inBuffer, outBuffer, mWriteBufferSize / mNChannels);
     }
 
-    void setIOL(double iValue, double oValue) {
-        mLastIoIdxL = (mLastIoIdxL + 1) % BUFFER_LEN;
-        mPrevInputsL[mLastIoIdxL] = iValue;
-        mPrevOutputsL[mLastIoIdxL] = oValue;
+    // Like fillBuffer, but for a given number of frames. This lets callers write
+    // straight into device memory, which may not hold a full buffer contiguously.
+    void fillFrames(const float *inBuffer, float *outBuffer, size_t numFrames) {
+        dsp::withChannelCount(mNChannels, [&](auto nChannels) {
+            fillFrames<decltype(nChannels)::value>(inBuffer, outBuffer, numFrames);
+        });
     }
 
-    void setIOR(double iValue, double oValue) {
-        mLastIoIdxR = (mLastIoIdxR + 1) % BUFFER_LEN;
-        mPrevInputsR[mLastIoIdxR] = iValue;
-        mPrevOutputsR[mLastIoIdxR] = oValue;
-    }
+  private:
+    // The channel count is a template parameter so that moving a frame in and
+    // out of the lanes compiles to fixed-size loads and stores.
+    template <size_t N_CHANNELS>
+    void fillFrames(const float *inBuffer, float *outBuffer, size_t numFrames) {
+        static_assert(N_CHANNELS <= MAX_CHANNELS);
+        size_t frame = 0;
+
+        // Frames during a mix ramp take the slow path, with a new mix for each.
+        if (mMix.isRamping()) {
+            size_t rampEnd = std::min(numFrames, mMix.remainingFrames());
+            for (; frame < rampEnd; frame++) {
+                const auto mixLanes = dsp::FloatLanes::splat(mMix.next());
+                fillFrame<N_CHANNELS>(inBuffer + frame * N_CHANNELS,
+                                      outBuffer + frame * N_CHANNELS, mixLanes);
+            }
+        }
 
-    double getNextL(const double newSample) {
-        double out = mBCoeffs[0] * newSample;
-        for (uint32_t i = 1; i < FILTER_SIZE; i++) {
-            out += mBCoeffs[i] * getIL(i);
-            out -= mACoeffs[i] * getOL(i);
+        const auto mixLanes = dsp::FloatLanes::splat(mMix.value());
+        for (; frame < numFrames; frame++) {
+            fillFrame<N_CHANNELS>(inBuffer + frame * N_CHANNELS, outBuffer + frame * N_CHANNELS,
+                                  mixLanes);
         }
-        return out;
     }
 
-    double getNextR(const double newSample) {
-        double out = mBCoeffs[0] * newSample;
-        for (uint32_t i = 1; i < FILTER_SIZE; i++) {
-            out += mBCoeffs[i] * getIR(i);
-            out -= mACoeffs[i] * getOR(i);
-        }
-        return out;
+    template <size_t N_CHANNELS>
+    void fillFrame(const float *inFrame, float *outFrame, dsp::FloatLanes mixLanes) {
+        dsp::FloatLanes in = dsp::FloatLanes::loadPartial<N_CHANNELS>(inFrame);
+        dsp::FloatLanes out = mixLanes * mFilter.process(in) + in;
+
+        out.storePartial<N_CHANNELS>(outFrame);
+        assert(!std::isnan(outFrame[0]));
     }
 };
 
@@ -0,0 +1,86 @@
+// Chooses the ALSA buffer size from what we have measured on this host.
+//
+// Starts from a target latency of 1 / LATENCY_FACTOR seconds, and after
+// each playback looks at the xruns and per-period processing times from
+// PlaybackStats: xruns double the latency, and playbacks that stayed well
+// within their time budget halve it, but never back down to a latency
+// that has already caused xruns.
+
+#ifndef LATENCY_CONTROLLER_H_
+#define LATENCY_CONTROLLER_H_
+
+#include "playback_stats.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace latency_controller {
+
+// The intent is for the latency due to buffering in the real-time playback
+// loop to start at 1 / LATENCY_FACTOR seconds. At 44.1khz and 48khz this
+// rounds to a 512 frame buffer.
+static constexpr unsigned int LATENCY_FACTOR = 100;
+
+static constexpr uint64_t INITIAL_LATENCY_US = 1'000'000 / LATENCY_FACTOR;
+static constexpr uint64_t MIN_LATENCY_US = 1'000;
+static constexpr uint64_t MAX_LATENCY_US = 200'000;
+
+// The ALSA buffer is split into this many periods.
+static constexpr std::size_t PERIODS_PER_BUFFER = 4;
+
+// Only lower the latency if the worst period used less than this
+// fraction of its time budget, over at least this many periods.
+static constexpr double MAX_LOAD_TO_DECREASE = 0.25;
+static constexpr uint64_t MIN_PERIODS_TO_DECREASE = 1000;
+
+} // namespace latency_controller
+
+class LatencyController {
+  public:
+    [[nodiscard]] uint64_t latencyUs() const {
+        return mLatencyUs;
+    }
+
+    // Buffer size for the current target latency, rounded up to a power of two.
+    [[nodiscard]] std::size_t bufferFrames(unsigned int sampleRate) const {
+        uint64_t frames = (sampleRate * mLatencyUs + 999'999) / 1'000'000;
+        return std::bit_ceil(std::max<uint64_t>(frames, latency_controller::PERIODS_PER_BUFFER));
+    }
+
+    [[nodiscard]] std::size_t periodFrames(unsigned int sampleRate) const {
+        return bufferFrames(sampleRate) / latency_controller::PERIODS_PER_BUFFER;
+    }
+
+    // Updates the target from the stats of a playback
+    // that used the given (actual) period duration.
+    void update(const PlaybackStatsSnapshot &stats, uint64_t periodTimeUs) {
+        using namespace latency_controller;
+
+        if (stats.mXruns > 0) {
+            // Don't come back down to this latency on this host.
+            mFailedLatencyUs = std::max(mFailedLatencyUs, mLatencyUs);
+            mLatencyUs = std::min(2 * mLatencyUs, MAX_LATENCY_US);
+            return;
+        }
+
+        if (stats.mPeriods < MIN_PERIODS_TO_DECREASE || periodTimeUs == 0) {
+            return;
+        }
+
+        double worstLoad = (stats.mWorstPeriodNs / 1000.0) / static_cast<double>(periodTimeUs);
+        uint64_t lowerLatencyUs = std::max(mLatencyUs / 2, MIN_LATENCY_US);
+
+        if (worstLoad < MAX_LOAD_TO_DECREASE && lowerLatencyUs > mFailedLatencyUs) {
+            mLatencyUs = lowerLatencyUs;
+        }
+    }
+
+  private:
+    uint64_t mLatencyUs = latency_controller::INITIAL_LATENCY_US;
+    // Highest latency at which we have seen xruns.
+    uint64_t mFailedLatencyUs = 0;
+};
+
+#endif // LATENCY_CONTROLLER_H_
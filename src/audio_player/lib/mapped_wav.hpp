@@ -0,0 +1,240 @@
+// Read-only memory mapping of WAV files, so samples that are already
+// in a format we can play are used in place instead of being decoded.
+
+#ifndef MAPPED_WAV_H_
+#define MAPPED_WAV_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+
+// --------------------------------
+// RAII wrapper for a mapped file.
+
+class MappedFile {
+  public:
+    // Returns std::nullopt if the file can't be opened or mapped.
+    static std::optional<MappedFile> open(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+            return std::nullopt;
+        }
+
+        struct stat fileStat{};
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+            ::close(fd);
+            return std::nullopt;
+        }
+
+        auto size = static_cast<std::size_t>(fileStat.st_size);
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+
+        // The mapping keeps its own reference to the file.
+        ::close(fd);
+
+        if (addr == MAP_FAILED) {
+            return std::nullopt;
+        }
+
+        // Playback reads front to back, so ask for aggressive readahead.
+        madvise(addr, size, MADV_SEQUENTIAL);
+
+        return MappedFile{static_cast<const std::byte *>(addr), size};
+    }
+
+    MappedFile(MappedFile &&other) noexcept
+        : mData(std::exchange(other.mData, nullptr)),
+          mSize(std::exchange(other.mSize, 0)),
+          mPageSize(other.mPageSize) {
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            unmap();
+            mData = std::exchange(other.mData, nullptr);
+            mSize = std::exchange(other.mSize, 0);
+            mPageSize = other.mPageSize;
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        unmap();
+    }
+
+    [[nodiscard]] const std::byte *data() const {
+        return mData;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return mSize;
+    }
+
+    // Starts asynchronous readahead of a byte range, so that touching
+    // it later is less likely to wait for the disk.
+    void prefetch(std::size_t offset, std::size_t length) const {
+        if (offset >= mSize) {
+            return;
+        }
+        // madvise needs a page-aligned start address.
+        std::size_t alignedOffset = offset - offset % mPageSize;
+        length = std::min(length + (offset - alignedOffset), mSize - alignedOffset);
+
+        madvise(const_cast<std::byte *>(mData) + alignedOffset, length, MADV_WILLNEED);
+    }
+
+    // Reads a byte of every page in a byte range, so the range is resident
+    // when this returns. It blocks on any major faults, so it is for the
+    // reader thread and never the playback thread.
+    void touch(std::size_t offset, std::size_t length) const {
+        std::size_t end = std::min(offset + length, mSize);
+        for (std::size_t pos = offset - offset % mPageSize; pos < end; pos += mPageSize) {
+            static_cast<void>(*static_cast<const volatile std::byte *>(mData + pos));
+        }
+    }
+
+  private:
+    MappedFile(const std::byte *data, std::size_t size)
+        : mData(data),
+          mSize(size),
+          mPageSize(static_cast<std::size_t>(sysconf(_SC_PAGESIZE))) {
+    }
+
+    void unmap() {
+        if (mData != nullptr) {
+            munmap(const_cast<std::byte *>(mData), mSize);
+            mData = nullptr;
+        }
+    }
+
+  private:
+    const std::byte *mData = nullptr;
+    std::size_t mSize = 0;
+    std::size_t mPageSize = 4096;
+};
+
+// ---------------------
+// Minimal WAV parsing.
+
+namespace mapped_wav {
+
+enum class SampleFormat {
+    Float32,
+    Int16,
+};
+
+struct WavInfo {
+    SampleFormat mFormat;
+    unsigned int mNumChannels = 0;
+    unsigned int mSampleRate = 0;
+    // Location of sample data in the file.
+    std::size_t mDataOffset = 0;
+    std::size_t mDataBytes = 0;
+};
+
+static constexpr uint16_t WAVE_FORMAT_PCM = 0x0001;
+static constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+static constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+inline uint16_t readU16(const std::byte *ptr) {
+    uint16_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline uint32_t readU32(const std::byte *ptr) {
+    uint32_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline bool hasId(const std::byte *ptr, const char (&id)[5]) {
+    return std::memcmp(ptr, id, 4) == 0;
+}
+
+// Finds the format and data chunks of a RIFF/WAVE file. Returns std::nullopt
+// unless the samples are little-endian float32 or int16 that can be played as-is.
+inline std::optional<WavInfo> parseHeader(const std::byte *data, std::size_t size) {
+    // Samples are used in place, so they must already be in host byte order.
+    if constexpr (std::endian::native != std::endian::little) {
+        return std::nullopt;
+    }
+
+    constexpr std::size_t RIFF_HEADER_SIZE = 12;
+    constexpr std::size_t CHUNK_HEADER_SIZE = 8;
+
+    if (size < RIFF_HEADER_SIZE || !hasId(data, "RIFF") || !hasId(data + 8, "WAVE")) {
+        return std::nullopt;
+    }
+
+    std::optional<WavInfo> info;
+    bool haveFormat = false;
+    std::size_t pos = RIFF_HEADER_SIZE;
+
+    while (pos + CHUNK_HEADER_SIZE <= size) {
+        const std::byte *chunk = data + pos;
+        std::size_t chunkSize = readU32(chunk + 4);
+        std::size_t bodyPos = pos + CHUNK_HEADER_SIZE;
+
+        if (hasId(chunk, "fmt ")) {
+            constexpr std::size_t MIN_FMT_SIZE = 16;
+            if (chunkSize < MIN_FMT_SIZE || bodyPos + chunkSize > size) {
+                return std::nullopt;
+            }
+            const std::byte *body = data + bodyPos;
+
+            uint16_t formatTag = readU16(body);
+            uint16_t bitsPerSample = readU16(body + 14);
+
+            // The real format tag is the first two bytes of the sub-format GUID.
+            constexpr std::size_t EXTENSIBLE_FMT_SIZE = 40;
+            if (formatTag == WAVE_FORMAT_EXTENSIBLE && chunkSize >= EXTENSIBLE_FMT_SIZE) {
+                formatTag = readU16(body + 24);
+            }
+
+            info = WavInfo{};
+            info->mNumChannels = readU16(body + 2);
+            info->mSampleRate = readU32(body + 4);
+
+            if (formatTag == WAVE_FORMAT_IEEE_FLOAT && bitsPerSample == 32) {
+                info->mFormat = SampleFormat::Float32;
+            } else if (formatTag == WAVE_FORMAT_PCM && bitsPerSample == 16) {
+                info->mFormat = SampleFormat::Int16;
+            } else {
+                return std::nullopt;
+            }
+            haveFormat = true;
+        } else if (hasId(chunk, "data")) {
+            if (!haveFormat || info->mNumChannels == 0) {
+                return std::nullopt;
+            }
+            // Writers that stream to disk sometimes leave the size unset.
+            info->mDataOffset = bodyPos;
+            info->mDataBytes = std::min(chunkSize, size - bodyPos);
+            return info;
+        }
+
+        // Chunks are padded to an even number of bytes.
+        pos = bodyPos + chunkSize + (chunkSize & 1);
+    }
+
+    return std::nullopt;
+}
+
+} // namespace mapped_wav
+
+#endif // MAPPED_WAV_H_
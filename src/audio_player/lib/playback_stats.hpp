@@ -0,0 +1,136 @@
+// Counters describing how well playback is keeping up with the device.
+//
+// These are kept by the playback thread in plain fields. It publishes
+// snapshot() copies to the UI thread along with the rest of its state
+// (see PlaybackSnapshot in alsa_player.hpp), so the UI sees counters
+// that all come from the same period.
+
+#ifndef PLAYBACK_STATS_H_
+#define PLAYBACK_STATS_H_
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace playback_stats {
+
+// Bucket 0 counts periods under 1us, and bucket i > 0 counts periods
+// in [2^(i-1), 2^i) us. The last bucket also counts anything longer.
+static constexpr std::size_t NUM_HISTOGRAM_BUCKETS = 16;
+
+// Sample the device delay every this many periods, since it costs a syscall.
+static constexpr std::size_t DELAY_SAMPLING_INTERVAL = 16;
+
+inline std::size_t histogramBucket(uint64_t periodNs) {
+    auto bucket = static_cast<std::size_t>(std::bit_width(periodNs / 1000));
+    return std::min(bucket, NUM_HISTOGRAM_BUCKETS - 1);
+}
+
+// Upper bound of a bucket in microseconds. The last bucket has none, so
+// for it this is the lower bound.
+inline uint64_t bucketLimitUs(std::size_t bucket) {
+    if (bucket == NUM_HISTOGRAM_BUCKETS - 1) {
+        return uint64_t{1} << (bucket - 1);
+    }
+    return uint64_t{1} << bucket;
+}
+
+inline bool isOpenBucket(std::size_t bucket) {
+    return bucket == NUM_HISTOGRAM_BUCKETS - 1;
+}
+
+} // namespace playback_stats
+
+// Plain copy of the stats, for display and export.
+struct PlaybackStatsSnapshot {
+    uint64_t mPeriods = 0;
+    uint64_t mXruns = 0;
+    uint64_t mWorstPeriodNs = 0;
+    int64_t mDelayFrames = 0;
+    int64_t mAvailFrames = 0;
+    int64_t mMinDelayFrames = 0;
+    std::array<uint64_t, playback_stats::NUM_HISTOGRAM_BUCKETS> mHistogram{};
+
+    [[nodiscard]] std::string toText() const {
+        std::string text = fmt::format(
+            "periods: {}, xruns: {}, worst period: {:.1f} us, delay: {} frames "
+            "(min {}), avail: {} frames\n",
+            mPeriods, mXruns, mWorstPeriodNs / 1000.0, mDelayFrames, mMinDelayFrames,
+            mAvailFrames);
+
+        for (std::size_t bucket = 0; bucket < mHistogram.size(); bucket++) {
+            text += fmt::format("  {:>2} {:6} us: {}\n",
+                                playback_stats::isOpenBucket(bucket) ? ">=" : "<",
+                                playback_stats::bucketLimitUs(bucket), mHistogram[bucket]);
+        }
+        return text;
+    }
+
+    [[nodiscard]] std::string toJson() const {
+        std::string histogram;
+        for (std::size_t bucket = 0; bucket < mHistogram.size(); bucket++) {
+            histogram += fmt::format("{}{{\"{}\": {}, \"count\": {}}}", bucket > 0 ? ", " : "",
+                                     playback_stats::isOpenBucket(bucket) ? "ge_us" : "lt_us",
+                                     playback_stats::bucketLimitUs(bucket), mHistogram[bucket]);
+        }
+        return fmt::format("{{\"periods\": {}, \"xruns\": {}, \"worst_period_ns\": {}, "
+                           "\"delay_frames\": {}, \"min_delay_frames\": {}, "
+                           "\"avail_frames\": {}, \"period_histogram\": [{}]}}\n",
+                           mPeriods, mXruns, mWorstPeriodNs, mDelayFrames, mMinDelayFrames,
+                           mAvailFrames, histogram);
+    }
+};
+
+class PlaybackStats {
+  public:
+    // Called by the playback thread before it starts playing.
+    void reset() {
+        *this = PlaybackStats{};
+    }
+
+    // Records the processing time of one period.
+    void recordPeriod(uint64_t periodNs) {
+        mPeriods++;
+        mHistogram[playback_stats::histogramBucket(periodNs)]++;
+        mWorstPeriodNs = std::max(mWorstPeriodNs, periodNs);
+    }
+
+    void recordXrun() {
+        mXruns++;
+    }
+
+    void recordDelay(int64_t delayFrames, int64_t availFrames) {
+        mDelayFrames = delayFrames;
+        mAvailFrames = availFrames;
+        mMinDelayFrames = std::min(mMinDelayFrames, delayFrames);
+    }
+
+    [[nodiscard]] PlaybackStatsSnapshot snapshot() const {
+        PlaybackStatsSnapshot snap;
+        snap.mPeriods = mPeriods;
+        snap.mXruns = mXruns;
+        snap.mWorstPeriodNs = mWorstPeriodNs;
+        snap.mDelayFrames = mDelayFrames;
+        snap.mAvailFrames = mAvailFrames;
+        snap.mMinDelayFrames = mMinDelayFrames == INT64_MAX ? 0 : mMinDelayFrames;
+        snap.mHistogram = mHistogram;
+        return snap;
+    }
+
+  private:
+    uint64_t mPeriods = 0;
+    uint64_t mXruns = 0;
+    uint64_t mWorstPeriodNs = 0;
+    int64_t mDelayFrames = 0;
+    int64_t mAvailFrames = 0;
+    int64_t mMinDelayFrames = INT64_MAX;
+
+    std::array<uint64_t, playback_stats::NUM_HISTOGRAM_BUCKETS> mHistogram{};
+};
+
+#endif // PLAYBACK_STATS_H_
@@ -1,68 +1,56 @@
 #ifndef PROCESSING_THREAD_H_
 #define PROCESSING_THREAD_H_
 
+#include "alloc_counter.hpp"
 #include "alsa_player.hpp"
 #include "rt_queue.hpp"
-#include <dsp/dsp_tools.hpp>
+#include "spectrogram.hpp"
+#include "spectrum_analyzer.hpp"
+#include "spectrum_engine.hpp"
 
-#include <kfr/dft/fft.hpp>
-
-#include <cstdlib>
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cassert>
-#include <complex>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <numbers>
+#include <optional>
+
+// The latest frame, for the meters; older frames are skipped.
+using SpectrumSnapshot = TripleBuffer<proc_thread::SpectrumFrame>;
+// Every spectrogram row, for the waterfall.
+using RowQueue = QueueHolder<SpectrogramRow>;
 
 namespace proc_thread {
 
-// Range of frequencies to display.
-static constexpr size_t MIN_FREQ = 60;
-static constexpr size_t MAX_FREQ = 12'000;
-
-// Binning config.
-static constexpr size_t NUM_SPECTROGRAM_BINS = 4;
-
-// Octave-based distribution into bins.
-static constexpr double BIN_0_CUTOFF = 250;
-static constexpr double BIN_1_CUTOFF = 1000;
-static constexpr double BIN_2_CUTOFF = 4000;
-
-static size_t getBin(double freq) {
-    if (freq <= BIN_0_CUTOFF) {
-        return 0;
-    } else if (freq <= BIN_1_CUTOFF) {
-        return 1;
-    } else if (freq <= BIN_2_CUTOFF) {
-        return 2;
-    } else {
-        return 3;
-    }
-}
+// If the thread falls further behind than this many windows, it skips to the newest ones.
+static constexpr size_t MAX_WINDOWS_BEHIND = 2;
 
 } // namespace proc_thread
 
-using MainQueue = QueueHolder<proc_thread::NUM_SPECTROGRAM_BINS>;
-using ProcQueue = QueueHolder<alsa_player::PROCESSING_WINDOW_SIZE>;
-
 class ProcessingThread {
-    // Queues are named after their receiver.
-    MainQueue mMainThreadQueue;
-    ProcQueue mProcessingQueue;
-
-    // To allow external shutdown.
+    // To the main thread.
+    SpectrumSnapshot *mSpectrum;
+    RowQueue mRowQueue;
+    // The playback thread's filtered output.
+    TapBus *mTap;
+
+    // To allow external shutdown. Ring the tap's doorbell
+    // after clearing this, so the thread wakes to see it.
     std::atomic_bool &mRunning;
 
     uint32_t mAudioSampleRate = 0;
+    uint32_t mAudioChannels = 1;
+    proc_thread::FftEngine mFftEngine = proc_thread::FftEngine::Double;
+    proc_thread::BandLayout mBandLayout = proc_thread::BandLayout::Octave;
 
   public:
-    ProcessingThread(MainQueue mainThreadQueue, ProcQueue processingQueue,
+    ProcessingThread(SpectrumSnapshot &spectrum, RowQueue rowQueue, TapBus &tap,
                      std::atomic_bool &running)
-        : mMainThreadQueue(mainThreadQueue),
-          mProcessingQueue(processingQueue),
+        : mSpectrum(&spectrum),
+          mRowQueue(rowQueue),
+          mTap(&tap),
           mRunning(running) {
     }
 
@@ -71,91 +59,154 @@ class ProcessingThread {
         mAudioSampleRate = audioSampleRate;
     }
 
+    void setAudioChannels(uint32_t audioChannels) {
+        assert(!mRunning);
+        assert(audioChannels >= 1);
+        mAudioChannels = audioChannels;
+    }
+
+    void setFftEngine(proc_thread::FftEngine engine) {
+        assert(!mRunning);
+        mFftEngine = engine;
+    }
+
+    void setBandLayout(proc_thread::BandLayout layout) {
+        assert(!mRunning);
+        mBandLayout = layout;
+    }
+
+    // The engine in use. The fractional octave layouts always use the float
+    // engine, with the long analysis FFT.
+    [[nodiscard]] proc_thread::FftEngine fftEngine() const {
+        return usesAnalyzerFft() ? proc_thread::FftEngine::Float : mFftEngine;
+    }
+
+    [[nodiscard]] size_t fftSize() const {
+        constexpr size_t WINDOW_SIZE = alsa_player::PROCESSING_WINDOW_SIZE;
+        if (usesAnalyzerFft()) {
+            return proc_thread::ANALYZER_FFT_SIZE;
+        }
+        return mFftEngine == proc_thread::FftEngine::Float
+                   ? FloatSpectrumEngine<WINDOW_SIZE>::FFT_LEN
+                   : DoubleSpectrumEngine<WINDOW_SIZE>::FFT_LEN;
+    }
+
+    [[nodiscard]] proc_thread::BandEdges bandEdges() const {
+        return proc_thread::bandEdges(mBandLayout, mAudioSampleRate);
+    }
+
     void operator()() {
-        constexpr size_t FFT_LEN = 1.5 * alsa_player::PROCESSING_WINDOW_SIZE;
-        constexpr size_t NUM_BINS = proc_thread::NUM_SPECTROGRAM_BINS;
-        size_t bindWidth = (proc_thread::MAX_FREQ - proc_thread::MIN_FREQ) / NUM_BINS;
+        constexpr size_t WINDOW_SIZE = alsa_player::PROCESSING_WINDOW_SIZE;
+        using AnalyzerEngine = FloatSpectrumEngine<WINDOW_SIZE, proc_thread::ANALYZER_FFT_SIZE,
+                                                   proc_thread::ANALYZER_HOP>;
+
+        proc_thread::BandEdges edges = bandEdges();
+        dsp::BinWeighting weighting = proc_thread::binWeighting(mBandLayout);
+
+        if (usesAnalyzerFft()) {
+            AnalyzerEngine engine{mAudioSampleRate, edges.edges(), weighting};
+            runLoop(engine);
+        } else if (mFftEngine == proc_thread::FftEngine::Float) {
+            FloatSpectrumEngine<WINDOW_SIZE> engine{mAudioSampleRate, edges.edges(), weighting};
+            runLoop(engine);
+        } else {
+            DoubleSpectrumEngine<WINDOW_SIZE> engine{mAudioSampleRate, edges.edges(), weighting};
+            runLoop(engine);
+        }
+    }
+
+  private:
+    [[nodiscard]] bool usesAnalyzerFft() const {
+        return mBandLayout != proc_thread::BandLayout::Octave;
+    }
+
+    template <typename Engine>
+    void runLoop(Engine &engine) {
+        // Allocations seen by this thread after the first pass; later passes must not add any.
+        std::optional<uint64_t> warmAllocations;
+
+        constexpr size_t WINDOW_SIZE = alsa_player::PROCESSING_WINDOW_SIZE;
+        const size_t channels = mAudioChannels;
+        const size_t windowSamples = WINDOW_SIZE * channels;
 
-        std::array hannWindow = dsp::makeHannWindow<FFT_LEN>();
-        kfr::dft_plan_real<double> plan(FFT_LEN);
-        kfr::univector<std::complex<double>, FFT_LEN> prevFftData{0};
+        SpectrumAnalyzer analyzer{mBandLayout, engine.numBands(), Engine::FULL_SCALE_LEVEL};
+        std::array<float, proc_thread::MAX_BANDS> levels{};
+        SpectrogramRowBuilder rowBuilder;
 
-        using namespace std::complex_literals;
-        using namespace std::numbers;
+        // Reads whole frames of the interleaved output, starting from now.
+        TapReader reader{*mTap, channels};
+        std::array<float, WINDOW_SIZE> window{};
+        size_t windowFrame = 0;
 
-        // Euler's formula for e^(i*pi*2/3) for modulating previous FFT for overlap add.
-        static const std::complex<double> MODULATION_FACTOR =
-            std::cos(2.0 * pi / 3.0) + std::sin(2.0 * pi / 3.0) * 1i;
+        // After a gap in the samples, neither the partial window nor the
+        // engine's history follows on from what comes next.
+        auto startOver = [&engine, &windowFrame]() {
+            windowFrame = 0;
+            engine.reset();
+        };
 
         while (true) {
-            while (mRunning && mProcessingQueue.queueRef.size() == 0)
-                ;
-            // Discard older data and get the most recent.
-            while (mProcessingQueue.queueRef.size() > 1) {
-                mProcessingQueue.queueRef.pop();
+            // Sleep until the playback thread publishes a window, or we are stopped.
+            size_t wanted = (WINDOW_SIZE - windowFrame) * channels;
+            uint32_t seenSequence = mTap->doorbell().sequence();
+            if (mRunning && reader.available() < wanted) {
+                mTap->doorbell().wait(seenSequence);
+                continue;
             }
             if (!mRunning) {
                 break;
             }
+            // Discard older data and start a new window from the most recent.
+            if (reader.available() > proc_thread::MAX_WINDOWS_BEHIND * windowSamples) {
+                reader.skipTo(proc_thread::MAX_WINDOWS_BEHIND * windowSamples);
+                startOver();
+                wanted = windowSamples;
+            }
 
-            alsa_player::AlsaData::array_type &windowData = mProcessingQueue.queueRef.front()->data;
-
-            // Copy data with window function applied into second two-thirds of buffer.
-            kfr::univector<double, FFT_LEN> inData = {0.0};
-            for (size_t i = FFT_LEN / 3; i < FFT_LEN; i++) {
-                inData[i] = hannWindow[i] * windowData[i];
+            // Sum the channels of each frame straight from the tap into the window.
+            TapReader::View samples = reader.acquire(wanted);
+            // The playback thread lapped us since the last window; start a new one
+            // from where the reader was moved to.
+            if (samples.skipped()) {
+                startOver();
+                continue;
             }
-            mProcessingQueue.queueRef.pop();
-
-            // Take fourier transform of windowed data.
-            kfr::univector<cometa::u8> temp(plan.temp_size);
-            kfr::univector<std::complex<double>, FFT_LEN> fftData;
-            plan.execute(fftData, inData, temp);
-
-            auto getFreqHerz = [FFT_LEN, this](size_t harmonic) -> double {
-                size_t folded = harmonic > FFT_LEN / 2 ? FFT_LEN - harmonic : harmonic;
-
-                // This is sample rate in Hz / period of sinusoid = oscillation frequency of
-                // sinusoidal component of Fourier decomposition. In other words, this is the
-                // frequency of the signal that this component represents.
-                return mAudioSampleRate * (folded / (double)FFT_LEN);
-
-                // For binning here, we count frequencies along with their negatives, because we
-                // only care about the rates of oscillation, not the effects of cancellation.
-                //
-                // Note: Recall that the real parts of the coefficients are even, and
-                //       note that the highest unique absolute frequency represented
-                //       is the Nyquist frequency.
-            };
-
-            // Overlap add FFT with previous FFT data and put in appropriate frequency bins.
-            MainQueue::data_type newData{};
-            std::complex<double> modulation = 1;
-            for (size_t harmonic = 0; harmonic < FFT_LEN; harmonic++) {
-                size_t realFreq = getFreqHerz(harmonic);
-
-                if (realFreq < proc_thread::MIN_FREQ || proc_thread::MAX_FREQ < realFreq) {
-                    continue;
+            for (size_t j = 0; j < samples.size(); j += channels) {
+                float frameSum = 0.0f;
+                for (size_t c = 0; c < channels; c++) {
+                    frameSum += samples[j + c];
                 }
+                window[windowFrame++] = frameSum;
+            }
+            // The playback thread overwrote them as we read, so samples were lost;
+            // start a new window.
+            if (!reader.release(samples)) {
+                startOver();
+                continue;
+            }
+            if (windowFrame < WINDOW_SIZE) {
+                continue;
+            }
+            windowFrame = 0;
+
+            if (!engine.process(window.data(), levels.data())) {
+                continue;
+            }
 
-                // We translate the previous signal back in time by half the FFT length;
-                // since FT converts time translation to modulation, we multiply by a
-                // modulation factor, which is a pure complex exponential.
-                modulation *= MODULATION_FACTOR;
-                // This is multiplying previous FFT sequence X(k) by e^(i*pi*k) = (-1)^k,
-                // which is equivalent to FFT[X(k-N/2)]. Because the Fourier transform
-                // is linear,this amounts to FFTing the overlap of two sampling windows.
-                std::complex<double> overlapped =
-                    fftData[harmonic] + modulation * prevFftData[harmonic];
-
-                // Add magnitude of coefficient (roughly energy in this frequency)
-                // of the FFT of overlapped windows to the appropriate bin.
-                newData.data[proc_thread::getBin(realFreq)] += std::abs(overlapped);
+            // The frame is built in place, then handed over whole.
+            proc_thread::SpectrumFrame &frame = mSpectrum->back();
+            analyzer.process(levels.data(), frame);
+            frame.mTapOverruns = reader.overruns();
+            if (rowBuilder.addFrame(frame)) {
+                // Dropped if the main thread is behind.
+                bool _ = mRowQueue.tryPush(rowBuilder.row());
             }
+            mSpectrum->publish();
 
-            // Put data in queue or drop it.
-            bool _ = mMainThreadQueue.queueRef.try_push(newData);
-            prevFftData = std::move(fftData);
+            if (!warmAllocations) {
+                warmAllocations = alloc_counter::threadAllocations();
+            }
+            assert(alloc_counter::threadAllocations() == *warmAllocations);
         }
     }
 };
@@ -0,0 +1,233 @@
+// A logger that the real-time playback thread can use.
+//
+// Logging a message writes a fixed-size binary record, a message id plus its
+// arguments, into a lock-free SPSC ring, so it never allocates, formats or
+// takes a lock. A background drain thread turns the records into text later
+// and writes them to a file, or passes them on to be shown as the console's
+// end note. If the ring is full the message is dropped and counted, and the
+// drain thread reports how many were lost.
+
+#ifndef RT_LOGGER_H_
+#define RT_LOGGER_H_
+
+#include "doorbell.hpp"
+#include "threadsafe_queue.hpp"
+
+#include <fmt/args.h>
+#include <fmt/format.h>
+#include <rigtorp/SPSCQueue.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <variant>
+
+// Formatted messages for the main thread to show.
+using MessageQueue = ThreadsafeQueue<std::string>;
+
+namespace rt_log {
+
+static constexpr size_t RING_CAPACITY = 256;
+static constexpr size_t MAX_ARGS = 4;
+// Longer text is cut off.
+static constexpr size_t MAX_TEXT = 128;
+
+enum class MessageId : uint16_t {
+    // Text copied into the record as is.
+    Text,
+    Underrun,
+    WriteFailed,
+    ShortCommit,
+    Suspended,
+};
+
+inline const char *formatString(MessageId id) {
+    switch (id) {
+    case MessageId::Underrun:
+        return "Underrun at period {} of {}; the device was restarted.";
+    case MessageId::WriteFailed:
+        return "Failed to write to PCM device: {}";
+    case MessageId::ShortCommit:
+        return "The device took {} of {} mmap frames; the rest of the period was dropped.";
+    case MessageId::Suspended:
+        return "The device was suspended, and resumed after {} s.";
+    default:
+        return "{}";
+    }
+}
+
+// Arguments are kept by value. Strings are kept by pointer, so they must
+// outlive the drain, like string literals and snd_strerror() results.
+using Arg = std::variant<int64_t, uint64_t, double, const char *>;
+
+template <typename T>
+Arg toArg(T value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        return static_cast<double>(value);
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        return static_cast<int64_t>(value);
+    } else if constexpr (std::is_integral_v<T>) {
+        return static_cast<uint64_t>(value);
+    } else {
+        return static_cast<const char *>(value);
+    }
+}
+
+struct Record {
+    MessageId mId = MessageId::Text;
+    uint8_t mNumArgs = 0;
+    std::array<Arg, MAX_ARGS> mArgs{};
+
+    // Only for MessageId::Text.
+    uint8_t mTextLength = 0;
+    std::array<char, MAX_TEXT> mText{};
+};
+
+inline std::string format(const Record &record) {
+    if (record.mId == MessageId::Text) {
+        return {record.mText.data(), record.mTextLength};
+    }
+
+    fmt::dynamic_format_arg_store<fmt::format_context> args;
+    for (size_t i = 0; i < record.mNumArgs; i++) {
+        std::visit([&args](auto value) { args.push_back(value); }, record.mArgs[i]);
+    }
+    return fmt::vformat(formatString(record.mId), args);
+}
+
+} // namespace rt_log
+
+class RtLogger {
+  public:
+    // Until start() is called, messages wait in the ring.
+    explicit RtLogger(MessageQueue &endNotes)
+        : mRing(rt_log::RING_CAPACITY),
+          mEndNotes(endNotes) {
+    }
+
+    RtLogger(const RtLogger &) = delete;
+    RtLogger &operator=(const RtLogger &) = delete;
+
+    ~RtLogger() {
+        stop();
+    }
+
+    // Starts the drain thread. Messages are appended to the file at filePath, or
+    // go to the end-note queue if it is empty or can't be opened; returns false
+    // in the latter case.
+    bool start(const std::string &filePath = {}) {
+        bool opened = true;
+        if (!filePath.empty()) {
+            mFile.open(filePath, std::ios::app);
+            opened = mFile.is_open();
+        }
+
+        mDraining = true;
+        mDrainThread = std::thread([this]() { drain(); });
+        return opened;
+    }
+
+    // Writes out what is left in the ring and stops the drain thread.
+    void stop() {
+        if (!mDrainThread.joinable()) {
+            return;
+        }
+        mDraining = false;
+        mDoorbell.ring();
+        mDrainThread.join();
+    }
+
+    // Producer side; safe to call from the real-time thread, but only one thread
+    // may log at a time. Arguments are numbers or long-lived C strings.
+    template <typename... Args>
+    void log(rt_log::MessageId id, Args... args) {
+        static_assert(sizeof...(Args) <= rt_log::MAX_ARGS, "Too many log arguments.");
+
+        rt_log::Record record;
+        record.mId = id;
+        record.mNumArgs = sizeof...(Args);
+        size_t i = 0;
+        ((record.mArgs[i++] = rt_log::toArg(args)), ...);
+        push(record);
+    }
+
+    // Producer side. Copies the text, up to MAX_TEXT characters.
+    void logText(std::string_view text) {
+        rt_log::Record record;
+        record.mTextLength = static_cast<uint8_t>(std::min(text.size(), rt_log::MAX_TEXT));
+        std::copy_n(text.data(), record.mTextLength, record.mText.begin());
+        push(record);
+    }
+
+    // Messages dropped because the ring was full.
+    [[nodiscard]] uint64_t dropped() const {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void push(const rt_log::Record &record) {
+        if (mRing.try_push(record)) {
+            mDoorbell.ring();
+        } else {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Drain thread.
+    void drain() {
+        uint64_t reportedDropped = 0;
+
+        while (true) {
+            uint32_t seenSequence = mDoorbell.sequence();
+            // Read before emptying the ring, so messages logged before stop() are written.
+            bool stopping = !mDraining;
+
+            while (const rt_log::Record *record = mRing.front()) {
+                write(rt_log::format(*record));
+                mRing.pop();
+            }
+
+            uint64_t dropped = mDropped.load(std::memory_order_relaxed);
+            if (dropped != reportedDropped) {
+                write(fmt::format("{} log messages dropped.", dropped - reportedDropped));
+                reportedDropped = dropped;
+            }
+
+            if (mFile.is_open()) {
+                mFile.flush();
+            }
+            if (stopping) {
+                break;
+            }
+            mDoorbell.wait(seenSequence);
+        }
+    }
+
+    void write(std::string &&message) {
+        if (mFile.is_open()) {
+            mFile << message << '\n';
+        } else {
+            mEndNotes.push(std::move(message));
+        }
+    }
+
+    rigtorp::SPSCQueue<rt_log::Record> mRing;
+    std::atomic<uint64_t> mDropped = 0;
+    Doorbell mDoorbell;
+
+    // Owned by the drain thread once it starts.
+    MessageQueue &mEndNotes;
+    std::ofstream mFile;
+
+    std::atomic_bool mDraining = false;
+    std::thread mDrainThread;
+};
+
+#endif // RT_LOGGER_H_
@@ -3,31 +3,293 @@
 
 // Definitions for working with SPSCQueue.
 
+#include "doorbell.hpp"
+
 #include <rigtorp/SPSCQueue.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
 
 using namespace rigtorp;
 
 static constexpr std::size_t QUEUE_CAP = 20;
 
-template <size_t N>
-struct Data {
-    using array_type = std::array<float, N>;
+// For keeping data written by different threads on separate cache lines.
+#ifdef __cpp_lib_hardware_interference_size
+static constexpr std::size_t CACHE_LINE_SIZE = std::hardware_destructive_interference_size;
+#else
+static constexpr std::size_t CACHE_LINE_SIZE = 64;
+#endif
+
+// A queue of messages of type T, plus the doorbell rung when one is pushed.
+template <typename T>
+struct QueueHolder {
+    using queue_type = SPSCQueue<T>;
+    using data_type = T;
+
+    queue_type &queueRef;
+    // Rung after each push, for a consumer that sleeps while the queue is empty.
+    Doorbell *doorbell = nullptr;
 
-    array_type data;
+    // Drops the data if the queue is full.
+    bool tryPush(const data_type &data) {
+        bool pushed = queueRef.try_push(data);
+        if (pushed && doorbell != nullptr) {
+            doorbell->ring();
+        }
+        return pushed;
+    }
 };
 
-template <size_t N>
-using DataQueue = SPSCQueue<Data<N>>;
+// -----------------------------------------------
+// Latest-value handoff from one thread to another.
 
-template <size_t N>
-struct QueueHolder {
-    using queue_type = DataQueue<N>;
-    using data_type = Data<N>;
+// A single-producer single-consumer triple buffer. The writer fills back() and
+// calls publish(), and the reader calls update() to take the latest published
+// value into front(). Each side does one atomic exchange and never waits for
+// the other, so the reader can be a real-time thread. Values published between
+// two updates are skipped, which is what we want for settings and snapshots.
+template <typename T>
+class TripleBuffer {
+  public:
+    // Writer side. The slot may hold an old value, so it should be fully rewritten.
+    T &back() {
+        return mSlots[mBack].mValue;
+    }
 
-    queue_type &queueRef;
+    void publish() {
+        uint8_t previous = mMiddle.exchange(mBack | FRESH_BIT, std::memory_order_acq_rel);
+        mBack = previous & INDEX_MASK;
+    }
+
+    // Writer side. Publishes a copy of a whole value.
+    void publish(const T &value) {
+        back() = value;
+        publish();
+    }
+
+    // Reader side. Returns true if front() changed.
+    bool update() {
+        if ((mMiddle.load(std::memory_order_relaxed) & FRESH_BIT) == 0) {
+            return false;
+        }
+        uint8_t previous = mMiddle.exchange(mFront, std::memory_order_acq_rel);
+        mFront = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T &front() const {
+        return mSlots[mFront].mValue;
+    }
+
+  private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    // Set in mMiddle when it holds a value the reader hasn't taken yet.
+    static constexpr uint8_t FRESH_BIT = 0x4;
+
+    // Slots and indices each have their own cache lines, so the two threads
+    // only contend on mMiddle, and only when one of them swaps.
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        T mValue{};
+    };
+    std::array<Slot, 3> mSlots{};
+
+    // Owned by the writer.
+    alignas(CACHE_LINE_SIZE) uint8_t mBack = 0;
+    // Slot index, plus FRESH_BIT.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint8_t> mMiddle = 1;
+    // Owned by the reader.
+    alignas(CACHE_LINE_SIZE) uint8_t mFront = 2;
+};
+
+// ----------------------------------------------
+// Broadcast of a sample stream to many readers.
+
+// A single-producer, multi-consumer ring of samples. The writer publishes each
+// block once, and each reader is a TapReader with its own cursor, so readers
+// come and go without the writer knowing about them. The writer never waits:
+// it overwrites the oldest samples, and a reader that falls more than the
+// capacity behind finds out and skips ahead, counting an overrun.
+//
+// Samples are relaxed atomics, which compile to plain loads and stores, so a
+// reader racing the writer reads stale or new values rather than undefined
+// behavior; it then checks whether the writer got to them and discards them.
+class TapBus {
+  public:
+    // Capacity in samples, rounded up to a power of two.
+    explicit TapBus(std::size_t capacity)
+        : mCapacity(std::bit_ceil(capacity)),
+          mMask(mCapacity - 1),
+          mRing(std::make_unique<std::atomic<float>[]>(mCapacity)) {
+    }
+
+    TapBus(const TapBus &) = delete;
+    TapBus &operator=(const TapBus &) = delete;
+
+    // Writer side; safe to call from the real-time thread.
+    void publish(const float *samples, std::size_t count) {
+        uint64_t start = mPublished.load(std::memory_order_relaxed);
+        uint64_t end = start + count;
+
+        // Claim the samples before writing them, so a reader that sees any new
+        // sample also sees that the old one there is gone.
+        mClaimed.store(end, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (std::size_t i = 0; i < count; i++) {
+            mRing[(start + i) & mMask].store(samples[i], std::memory_order_relaxed);
+        }
+        mPublished.store(end, std::memory_order_release);
+        mDoorbell.ringAll();
+    }
+
+    // Total samples published so far.
+    [[nodiscard]] uint64_t published() const {
+        return mPublished.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] std::size_t capacity() const {
+        return mCapacity;
+    }
+
+    // Rung after each publish. Readers wait on it as with a queue's doorbell.
+    Doorbell &doorbell() {
+        return mDoorbell;
+    }
+
+  private:
+    friend class TapReader;
+
+    std::size_t mCapacity;
+    std::size_t mMask;
+    std::unique_ptr<std::atomic<float>[]> mRing;
+
+    // Samples published, and samples the writer may be overwriting.
+    std::atomic<uint64_t> mPublished = 0;
+    std::atomic<uint64_t> mClaimed = 0;
+
+    Doorbell mDoorbell;
+};
+
+// One consumer's view of a TapBus. Only its own thread may use it.
+//
+// Samples are read in whole frames of frameSize samples, e.g. one per channel
+// of interleaved audio, as long as the writer publishes whole frames too. When
+// the reader skips ahead it skips whole frames, so channels stay in place.
+class TapReader {
+  public:
+    // Starts with the next sample published.
+    explicit TapReader(const TapBus &bus, std::size_t frameSize = 1)
+        : mBus(&bus),
+          mFrameSize(frameSize),
+          mCursor(bus.published()) {
+    }
+
+    // Samples published that this reader hasn't read, up to the capacity.
+    [[nodiscard]] std::size_t available() const {
+        return static_cast<std::size_t>(
+            std::min<uint64_t>(mBus->published() - mCursor, mBus->mCapacity));
+    }
+
+    // Skips older samples so that at most keep samples are left to read.
+    void skipTo(std::size_t keep) {
+        uint64_t published = mBus->published();
+        if (published - mCursor > keep) {
+            advanceTo(published - keep);
+        }
+    }
+
+    // The oldest unread samples, read in place in the ring, so the reader can
+    // work on them without copying them out first.
+    class View {
+      public:
+        [[nodiscard]] std::size_t size() const {
+            return mCount;
+        }
+
+        [[nodiscard]] float operator[](std::size_t i) const {
+            return mBus->mRing[(mStart + i) & mBus->mMask].load(std::memory_order_relaxed);
+        }
+
+        // True if acquire() skipped overwritten samples to get here, so this
+        // view doesn't follow on from the last one released.
+        [[nodiscard]] bool skipped() const {
+            return mSkipped;
+        }
+
+      private:
+        friend class TapReader;
+
+        View(const TapBus &bus, uint64_t start, std::size_t count, bool skipped)
+            : mBus(&bus),
+              mStart(start),
+              mCount(count),
+              mSkipped(skipped) {
+        }
+
+        const TapBus *mBus;
+        uint64_t mStart;
+        std::size_t mCount;
+        bool mSkipped;
+    };
+
+    // Up to maxCount of the oldest unread samples, in whole frames. If the writer
+    // has already overwritten unread samples, they are skipped, counted as an
+    // overrun and reported by View::skipped(). The samples stay unread until
+    // release().
+    View acquire(std::size_t maxCount) {
+        const TapBus &bus = *mBus;
+        uint64_t published = bus.mPublished.load(std::memory_order_acquire);
+        bool skipped = published - mCursor > bus.mCapacity;
+        if (skipped) {
+            advanceTo(published - bus.mCapacity);
+            mOverruns++;
+        }
+
+        maxCount -= maxCount % mFrameSize;
+        auto count = static_cast<std::size_t>(std::min<uint64_t>(published - mCursor, maxCount));
+        return {bus, mCursor, count, skipped};
+    }
+
+    // Marks the view's samples read, once the caller is done with them. Returns
+    // false if the writer claimed any of them meanwhile, so what the caller read
+    // may be torn and must be discarded; that is counted as an overrun.
+    bool release(const View &view) {
+        const TapBus &bus = *mBus;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claimed = bus.mClaimed.load(std::memory_order_relaxed);
+        if (claimed - view.mStart > bus.mCapacity) {
+            advanceTo(claimed - bus.mCapacity);
+            mOverruns++;
+            return false;
+        }
+
+        mCursor = view.mStart + view.mCount;
+        return true;
+    }
+
+    // Times this reader fell behind and lost samples.
+    [[nodiscard]] uint64_t overruns() const {
+        return mOverruns;
+    }
+
+  private:
+    // Moves the cursor forward by whole frames, to at least the given position.
+    void advanceTo(uint64_t position) {
+        uint64_t skip = position - mCursor;
+        mCursor += (skip + mFrameSize - 1) / mFrameSize * mFrameSize;
+    }
+
+    const TapBus *mBus;
+    std::size_t mFrameSize;
+    uint64_t mCursor;
+    uint64_t mOverruns = 0;
 };
 
 #endif // RT_QUEUE_H_
@@ -0,0 +1,140 @@
+// Utilities for running the playback thread with real-time priority
+// and without page faults.
+
+#ifndef RT_THREAD_H_
+#define RT_THREAD_H_
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace rt_thread {
+
+struct RtOptions {
+    // Everything below is ignored unless this is set.
+    bool mEnabled = false;
+    // SCHED_FIFO priority; clamped to the range the system allows.
+    int mPriority = 80;
+    // CPU to pin the thread to, or -1 to leave affinity alone.
+    int mCpu = -1;
+    // Lock the process's memory so the playback loop can't page fault.
+    bool mLockMemory = true;
+};
+
+// What we were actually able to apply, with a reason for anything that failed.
+struct RtStatus {
+    bool mRealTime = false;
+    bool mPinned = false;
+    bool mLocked = false;
+    std::string mMessage;
+};
+
+inline std::string errorReason(int error) {
+    if (error == EPERM) {
+        return "permission denied (needs CAP_SYS_NICE or an rtprio limit)";
+    }
+    if (error == ENOMEM || error == EAGAIN) {
+        return "not allowed to lock that much memory (see ulimit -l)";
+    }
+    return std::strerror(error);
+}
+
+// Pins the calling thread to one CPU. Returns 0 or an error number.
+inline int pinToCpu(int cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+// Applies the options to the calling thread. Anything that fails is skipped,
+// so the thread keeps running with whatever settings could be applied.
+inline RtStatus makeRealTime(const RtOptions &options) {
+    RtStatus status;
+
+    if (!options.mEnabled) {
+        status.mMessage = "Real-time mode off.";
+        return status;
+    }
+
+    auto addMessage = [&status](const std::string &message) {
+        status.mMessage += status.mMessage.empty() ? message : " " + message;
+    };
+
+    int minPriority = sched_get_priority_min(SCHED_FIFO);
+    int maxPriority = sched_get_priority_max(SCHED_FIFO);
+    sched_param param{};
+    param.sched_priority = std::max(minPriority, std::min(options.mPriority, maxPriority));
+
+    if (int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param); err == 0) {
+        status.mRealTime = true;
+        addMessage("SCHED_FIFO priority " + std::to_string(param.sched_priority) + ".");
+    } else {
+        addMessage("SCHED_FIFO failed: " + errorReason(err) + ".");
+    }
+
+    if (options.mCpu >= 0) {
+        if (int err = pinToCpu(options.mCpu); err == 0) {
+            status.mPinned = true;
+            addMessage("Pinned to CPU " + std::to_string(options.mCpu) + ".");
+        } else {
+            addMessage("Pinning failed: " + errorReason(err) + ".");
+        }
+    }
+
+    if (options.mLockMemory) {
+        // With MCL_ONFAULT pages are locked as they are touched, instead of locking
+        // (and reading in) every mapping, which would load a mapped audio file in full.
+        // The buffers the playback loop uses are touched up front with prefault().
+        int flags = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+        flags |= MCL_ONFAULT;
+#endif
+        if (mlockall(flags) == 0) {
+            status.mLocked = true;
+            addMessage("Memory locked.");
+        } else {
+            addMessage("Memory locking failed: " + errorReason(errno) + ".");
+        }
+    }
+
+    return status;
+}
+
+// Undoes the process-wide part of makeRealTime.
+inline void unlockMemory(const RtStatus &status) {
+    if (status.mLocked) {
+        munlockall();
+    }
+}
+
+// Touches every page of a buffer so it is mapped (and locked) before real-time use.
+inline void prefault(void *data, std::size_t bytes) {
+    static const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    auto *bytePtr = static_cast<volatile unsigned char *>(data);
+
+    for (std::size_t i = 0; i < bytes; i += pageSize) {
+        bytePtr[i] = bytePtr[i];
+    }
+    if (bytes > 0) {
+        bytePtr[bytes - 1] = bytePtr[bytes - 1];
+    }
+}
+
+// Grows the stack now, so the loop doesn't fault when it calls deeper.
+inline void prefaultStack() {
+    constexpr std::size_t STACK_PREFAULT_BYTES = 64 * 1024;
+    volatile unsigned char stackSpace[STACK_PREFAULT_BYTES];
+    prefault(const_cast<unsigned char *>(stackSpace), STACK_PREFAULT_BYTES);
+}
+
+} // namespace rt_thread
+
+#endif // RT_THREAD_H_
@@ -0,0 +1,36 @@
+// The processing applied to each period on its way to the device.
+
+#ifndef SIGNAL_CHAIN_H_
+#define SIGNAL_CHAIN_H_
+
+#include "equalizer.hpp"
+#include "filter.hpp"
+
+#include <cstddef>
+
+class SignalChain {
+  public:
+    SignalChain(std::size_t samplesPerPeriod, std::size_t nChannels, unsigned int sampleRate,
+                EqualizerControls &eqControls)
+        : mBoost(samplesPerPeriod, nChannels, sampleRate),
+          mEqualizer(nChannels, sampleRate, eqControls) {
+    }
+
+    // Takes up settings changed by other threads. Called once per period.
+    void update(float boostMix) {
+        mBoost.setMix(boostMix);
+        mEqualizer.update();
+    }
+
+    // Processes interleaved frames. The output may be device memory.
+    void process(const float *inBuffer, float *outBuffer, std::size_t numFrames) {
+        mBoost.fillFrames(inBuffer, outBuffer, numFrames);
+        mEqualizer.processFrames(outBuffer, numFrames);
+    }
+
+  private:
+    IIRLowpassFilter mBoost;
+    GraphicEqualizer mEqualizer;
+};
+
+#endif // SIGNAL_CHAIN_H_
@@ -0,0 +1,93 @@
+// Rows of the waterfall view. The processing thread combines spectrum frames
+// into rows, and the main thread keeps the recent rows in a ring of fixed size.
+
+#ifndef SPECTROGRAM_H_
+#define SPECTROGRAM_H_
+
+#include "spectrum_analyzer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace spectrogram {
+
+// Rows kept, which bounds how many the console can show.
+static constexpr size_t HISTORY_ROWS = 64;
+
+// Analysis frames combined into each row. The processing thread makes about
+// 86 frames per second at 44.1 kHz, which would scroll by too quickly.
+static constexpr size_t FRAMES_PER_ROW = 4;
+
+} // namespace spectrogram
+
+struct SpectrogramRow {
+    proc_thread::BandLayout mLayout = proc_thread::BandLayout::Octave;
+    uint32_t mNumBands = 0;
+    std::array<float, proc_thread::MAX_BANDS> mLevelsDb{};
+};
+
+class SpectrogramRowBuilder {
+  public:
+    // Adds one analysis frame, and returns true when it completes a row. Each row
+    // keeps the loudest level of each band over its frames, so short transients
+    // still show.
+    bool addFrame(const proc_thread::SpectrumFrame &frame) {
+        if (frame.mLayout != mPending.mLayout || frame.mNumBands != mPending.mNumBands) {
+            mPending.mLayout = frame.mLayout;
+            mPending.mNumBands = frame.mNumBands;
+            mPendingFrames = 0;
+        }
+
+        for (size_t band = 0; band < frame.mNumBands; band++) {
+            float levelDb = frame.mLevelsDb[band];
+            mPending.mLevelsDb[band] =
+                mPendingFrames == 0 ? levelDb : std::max(mPending.mLevelsDb[band], levelDb);
+        }
+
+        if (++mPendingFrames < spectrogram::FRAMES_PER_ROW) {
+            return false;
+        }
+        mPendingFrames = 0;
+        return true;
+    }
+
+    // The row completed by the last addFrame() that returned true.
+    [[nodiscard]] const SpectrogramRow &row() const {
+        return mPending;
+    }
+
+  private:
+    SpectrogramRow mPending;
+    size_t mPendingFrames = 0;
+};
+
+class SpectrogramHistory {
+  public:
+    void addRow(const SpectrogramRow &row) {
+        mRows[mTotalRows % spectrogram::HISTORY_ROWS] = row;
+        mTotalRows++;
+    }
+
+    // Rows added since construction, including ones since overwritten. The
+    // console compares this with what it last drew to find the new rows.
+    [[nodiscard]] uint64_t totalRows() const {
+        return mTotalRows;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return std::min<uint64_t>(mTotalRows, spectrogram::HISTORY_ROWS);
+    }
+
+    // Age 0 is the newest row; age must be less than size().
+    [[nodiscard]] const SpectrogramRow &row(size_t age) const {
+        return mRows[(mTotalRows - 1 - age) % spectrogram::HISTORY_ROWS];
+    }
+
+  private:
+    std::array<SpectrogramRow, spectrogram::HISTORY_ROWS> mRows{};
+    uint64_t mTotalRows = 0;
+};
+
+#endif // SPECTROGRAM_H_
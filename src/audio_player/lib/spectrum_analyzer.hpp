@@ -0,0 +1,197 @@
+// Turns spectrum engine band levels into what the console draws: levels in
+// dB relative to a full-scale sine, with a peak hold per band.
+//
+// Bands are either the four octave-ish display bins, or 1/3 or 1/6 octave
+// bands over the audible range. Everything here has a fixed maximum size,
+// so frames can go through an SPSCQueue by value.
+
+#ifndef SPECTRUM_ANALYZER_H_
+#define SPECTRUM_ANALYZER_H_
+
+#include "spectrum_engine.hpp"
+
+#include <dsp/bin_map.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace proc_thread {
+
+enum class BandLayout {
+    // The four bins between MIN_FREQ and MAX_FREQ.
+    Octave,
+    ThirdOctave,
+    SixthOctave,
+};
+
+inline const char *bandLayoutString(BandLayout layout) {
+    switch (layout) {
+    case BandLayout::ThirdOctave:
+        return "1/3 octave";
+    case BandLayout::SixthOctave:
+        return "1/6 octave";
+    default:
+        return "octave";
+    }
+}
+
+// Fractional octave bands have centers 1000 * 2^(k / bandsPerOctave) Hz, as
+// in IEC 61260, from the one nearest ANALYZER_MIN_FREQ to the one nearest
+// ANALYZER_MAX_FREQ, so up to 31 bands at 1/3 octave and 61 at 1/6. Low bands
+// narrower than MIN_BAND_BINS bins of the ANALYZER_FFT_SIZE FFT are left out,
+// since a sine's main lobe would spill too far into the next bands. At
+// 44.1 kHz, 1/3 octave bands start at 25 Hz and 1/6 octave bands at 50 Hz.
+static constexpr double ANALYZER_MIN_FREQ = 20.0;
+static constexpr double ANALYZER_MAX_FREQ = 20'000.0;
+static constexpr double REFERENCE_FREQ = 1'000.0;
+
+// Half the width of the Hann main lobe. A sine centered in a band this wide
+// reads about 2 dB low, and in wider bands less.
+static constexpr double MIN_BAND_BINS = 2.0;
+
+static constexpr size_t MAX_BANDS = 64;
+
+// Levels are clamped to this, so silence has a finite level.
+static constexpr float FLOOR_DB = -100.0f;
+
+// A band's peak stays put this long, then falls at the given rate.
+static constexpr double PEAK_HOLD_SECONDS = 1.0;
+static constexpr double PEAK_DECAY_DB_PER_SECOND = 20.0;
+
+struct BandEdges {
+    size_t mNumBands = 0;
+    std::array<double, MAX_BANDS + 1> mEdges{};
+
+    [[nodiscard]] BandEdgeSpan edges() const {
+        return {mEdges.data(), mNumBands + 1};
+    }
+
+    // Geometric center of a band.
+    [[nodiscard]] double center(size_t band) const {
+        return std::sqrt(mEdges[band] * mEdges[band + 1]);
+    }
+};
+
+inline size_t bandsPerOctave(BandLayout layout) {
+    return layout == BandLayout::SixthOctave ? 6 : 3;
+}
+
+// The bands for the layout, at the sample rate of the audio being analyzed.
+inline BandEdges bandEdges(BandLayout layout, uint32_t sampleRate) {
+    BandEdges edges;
+    if (layout == BandLayout::Octave) {
+        edges.mNumBands = NUM_SPECTROGRAM_BINS;
+        std::copy(BIN_EDGES.begin(), BIN_EDGES.end(), edges.mEdges.begin());
+        return edges;
+    }
+
+    auto perOctave = static_cast<double>(bandsPerOctave(layout));
+    auto edge = [perOctave](double k) { return REFERENCE_FREQ * std::exp2(k / perOctave); };
+
+    auto first = static_cast<int>(std::round(perOctave * std::log2(ANALYZER_MIN_FREQ /
+                                                                   REFERENCE_FREQ)));
+    auto last = static_cast<int>(std::round(perOctave * std::log2(ANALYZER_MAX_FREQ /
+                                                                  REFERENCE_FREQ)));
+    double minWidth = MIN_BAND_BINS * static_cast<double>(sampleRate) / ANALYZER_FFT_SIZE;
+    while (first < last && edge(first + 0.5) - edge(first - 0.5) < minWidth) {
+        first++;
+    }
+
+    edges.mNumBands = std::min(static_cast<size_t>(last - first + 1), MAX_BANDS);
+    for (size_t i = 0; i <= edges.mNumBands; i++) {
+        edges.mEdges[i] = edge(first + static_cast<double>(i) - 0.5);
+    }
+    return edges;
+}
+
+// The lowest bands are only a bin or two wide, so they need the bins split
+// between them; the wide display bins keep whole bins.
+inline dsp::BinWeighting binWeighting(BandLayout layout) {
+    return layout == BandLayout::Octave ? dsp::BinWeighting::Nearest
+                                        : dsp::BinWeighting::Fractional;
+}
+
+// What the processing thread sends the main thread for each analysis window.
+struct SpectrumFrame {
+    BandLayout mLayout = BandLayout::Octave;
+    uint32_t mNumBands = 0;
+
+    // Band levels straight from the engine, for the octave level meters.
+    std::array<float, MAX_BANDS> mLevels{};
+    // Levels in dB relative to a full-scale sine, and their held peaks.
+    std::array<float, MAX_BANDS> mLevelsDb{};
+    std::array<float, MAX_BANDS> mPeaksDb{};
+
+    // Times the processing thread fell behind the tap and lost samples.
+    uint64_t mTapOverruns = 0;
+};
+
+} // namespace proc_thread
+
+// ------------------------------------
+// Band levels to dB, with peak hold.
+
+class SpectrumAnalyzer {
+    using Clock = std::chrono::steady_clock;
+
+  public:
+    // The full-scale level is the engine's FULL_SCALE_LEVEL, the band level
+    // it gives a full-scale sine; only the float engine's is calibrated.
+    SpectrumAnalyzer(proc_thread::BandLayout layout, size_t numBands, float fullScaleLevel)
+        : mLayout(layout),
+          mNumBands(std::min(numBands, proc_thread::MAX_BANDS)),
+          mInvFullScale(1.0f / fullScaleLevel) {
+        mPeaksDb.fill(proc_thread::FLOOR_DB);
+    }
+
+    // Fills the frame from the engine's levels for one window.
+    void process(const float *levels, proc_thread::SpectrumFrame &frame) {
+        auto now = Clock::now();
+        auto lastTime = std::exchange(mLastTime, now);
+
+        frame.mLayout = mLayout;
+        frame.mNumBands = static_cast<uint32_t>(mNumBands);
+        for (size_t band = 0; band < mNumBands; band++) {
+            float level = levels[band];
+            float levelDb = 20.0f * std::log10(std::max(level * mInvFullScale, MIN_RATIO));
+
+            if (levelDb >= mPeaksDb[band]) {
+                mPeaksDb[band] = levelDb;
+                mHoldUntil[band] = now + HOLD_DURATION;
+            } else if (now > mHoldUntil[band]) {
+                // Only the time since the hold ended counts.
+                auto decayStart = std::max(lastTime, mHoldUntil[band]);
+                std::chrono::duration<double> decayTime = now - decayStart;
+                auto decayDb =
+                    static_cast<float>(proc_thread::PEAK_DECAY_DB_PER_SECOND * decayTime.count());
+                mPeaksDb[band] = std::max(mPeaksDb[band] - decayDb, levelDb);
+            }
+
+            frame.mLevels[band] = level;
+            frame.mLevelsDb[band] = levelDb;
+            frame.mPeaksDb[band] = mPeaksDb[band];
+        }
+    }
+
+  private:
+    // Level ratio at FLOOR_DB.
+    static constexpr float MIN_RATIO = 1e-5f;
+    static constexpr auto HOLD_DURATION =
+        std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(proc_thread::PEAK_HOLD_SECONDS));
+
+    proc_thread::BandLayout mLayout;
+    size_t mNumBands;
+    float mInvFullScale;
+
+    std::array<float, proc_thread::MAX_BANDS> mPeaksDb{};
+    std::array<Clock::time_point, proc_thread::MAX_BANDS> mHoldUntil{};
+    Clock::time_point mLastTime = Clock::now();
+};
+
+#endif // SPECTRUM_ANALYZER_H_
@@ -0,0 +1,248 @@
+// Spectral analysis of windows of channel-summed samples, reduced to
+// frequency bands given by their edges in Hz.
+//
+// DoubleSpectrumEngine is the original analysis: a double-precision FFT of
+// 1.5 windows, combined with the previous FFT by overlap-add in the
+// frequency domain. FloatSpectrumEngine instead runs the windows through a
+// dsp::Stft, a float FFT of a power-of-two length that keeps only the N/2 + 1
+// unique bins of the real transform. Its FFT size, hop and window are set
+// below, independent of the windows the playback thread sends: a short FFT
+// for the four display bins, and a long one for the fractional octave bands.
+//
+// Both map FFT bins to bands with a dsp::BinMap built for the sample rate,
+// and allocate everything they need when constructed. A band's level is the
+// sum of the FFT magnitudes in it, and each engine's FULL_SCALE_LEVEL is the
+// level of a full-scale sine, which the analyzer shows as 0 dB. The float
+// engine counts negative frequencies and its window's main lobe, so that
+// holds at any frequency. The double engine is kept as it was and isn't
+// calibrated; see its FULL_SCALE_LEVEL.
+
+#ifndef SPECTRUM_ENGINE_H_
+#define SPECTRUM_ENGINE_H_
+
+#include <dsp/bin_map.hpp>
+#include <dsp/dsp_tools.hpp>
+#include <dsp/stft.hpp>
+
+#include <kfr/dft/fft.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <span>
+
+namespace proc_thread {
+
+// Range of frequencies to display.
+static constexpr size_t MIN_FREQ = 60;
+static constexpr size_t MAX_FREQ = 12'000;
+
+// Binning config.
+static constexpr size_t NUM_SPECTROGRAM_BINS = 4;
+
+// Octave-based distribution into bins; each bin includes its upper edge.
+static constexpr std::array<double, NUM_SPECTROGRAM_BINS + 1> BIN_EDGES = {
+    MIN_FREQ, 250, 1000, 4000, MAX_FREQ,
+};
+
+using SpectrumBins = std::array<float, NUM_SPECTROGRAM_BINS>;
+using BandEdgeSpan = std::span<const double>;
+
+enum class FftEngine {
+    Double,
+    Float,
+};
+
+inline const char *fftEngineString(FftEngine engine) {
+    return engine == FftEngine::Float ? "float" : "double";
+}
+
+// STFT for the float engine. The FFT size sets the frequency resolution,
+// sampleRate / STFT_FFT_SIZE, and how much audio each frame spans; the hop
+// sets how often frames are taken. This is 50% overlap.
+static constexpr size_t STFT_FFT_SIZE = 512;
+static constexpr size_t STFT_HOP = 256;
+static constexpr dsp::WindowType STFT_WINDOW = dsp::WindowType::Hann;
+
+// STFT for the fractional octave bands. A sixth of an octave at 25 Hz is under
+// 3 Hz wide, so these need bins about that narrow: 2.7 Hz at 44.1 kHz. Each
+// frame spans 370 ms of audio. The hop of one playback window gives a frame
+// per window, as with the other engines, so the meters and waterfall move at
+// the same pace in every layout; it costs one 16k-point FFT per window.
+static constexpr size_t ANALYZER_FFT_SIZE = 16'384;
+static constexpr size_t ANALYZER_HOP = 512;
+
+} // namespace proc_thread
+
+// ----------------------------
+// Original double-precision engine.
+
+template <size_t WINDOW_SIZE>
+class DoubleSpectrumEngine {
+  public:
+    static constexpr size_t FFT_LEN = 1.5 * WINDOW_SIZE;
+    // Bins from DC through Nyquist; the rest of the real FFT mirrors these.
+    static constexpr size_t NUM_FFT_BINS = FFT_LEN / 2 + 1;
+    // Nominal band level of a full-scale sine. This engine sums only the positive
+    // frequencies, over a Hann window cut to its last two thirds, and its
+    // overlap-add modulation only approximates a time shift, so the real level
+    // depends on frequency: with 512-sample windows at 48 kHz a full-scale sine
+    // reads about -5 dB at 100 Hz and 1 kHz, -1.6 dB at 500 Hz and +1.7 dB at
+    // 7 kHz. No single constant fixes that, so its levels are only comparable
+    // with each other; use the float engine for calibrated ones.
+    static constexpr float FULL_SCALE_LEVEL = FFT_LEN;
+
+    explicit DoubleSpectrumEngine(uint32_t sampleRate,
+                                  proc_thread::BandEdgeSpan bandEdges = proc_thread::BIN_EDGES,
+                                  dsp::BinWeighting weighting = dsp::BinWeighting::Nearest)
+        : mBinMap(bandEdges, FFT_LEN, sampleRate, weighting),
+          mPlan(FFT_LEN),
+          mTemp(mPlan.temp_size) {
+        using namespace std::complex_literals;
+        using namespace std::numbers;
+
+        // Euler's formula for e^(i*pi*2/3) for modulating previous FFT for overlap add.
+        const std::complex<double> MODULATION_FACTOR =
+            std::cos(2.0 * pi / 3.0) + std::sin(2.0 * pi / 3.0) * 1i;
+
+        // We translate the previous signal back in time by half the FFT length;
+        // since FT converts time translation to modulation, we multiply by a
+        // modulation factor, which is a pure complex exponential. As in the original
+        // loop, its power counts only the harmonics within the display range.
+        std::complex<double> modulation = 1;
+        for (size_t harmonic = 0; harmonic < NUM_FFT_BINS; harmonic++) {
+            double freq = sampleRate * (harmonic / (double)FFT_LEN);
+            if (proc_thread::MIN_FREQ <= freq && freq <= proc_thread::MAX_FREQ) {
+                modulation *= MODULATION_FACTOR;
+            }
+            mModulation[harmonic] = modulation;
+        }
+    }
+
+    [[nodiscard]] size_t numBands() const {
+        return mBinMap.numBands();
+    }
+
+    // Writes numBands() band levels. Always returns true; every window gives a frame.
+    bool process(const float *windowData, float *bands) {
+        // Copy data with window function applied into second two-thirds of buffer.
+        constexpr size_t DATA_START = FFT_LEN / 3;
+        for (size_t i = DATA_START; i < FFT_LEN; i++) {
+            mInData[i] = HANN_WINDOW[i] * windowData[i - DATA_START];
+        }
+
+        // Take fourier transform of windowed data. Ping-pong buffers: each pass writes
+        // one FFT and reads the other as the previous FFT, then the roles swap.
+        auto &fftData = mFftBuffers[mCurrent];
+        const auto &prevFftData = mFftBuffers[mCurrent ^ 1];
+        mPlan.execute(fftData, mInData, mTemp);
+        mCurrent ^= 1;
+
+        // Overlap add FFT with previous FFT data. Multiplying the previous FFT by the
+        // modulation is equivalent to FFTing it shifted in time, and because the
+        // Fourier transform is linear, this amounts to FFTing the overlap of two
+        // sampling windows. The plan only writes the bins up to Nyquist, so those are
+        // the only ones with anything to add.
+        for (size_t harmonic = 0; harmonic < NUM_FFT_BINS; harmonic++) {
+            std::complex<double> overlapped =
+                fftData[harmonic] + mModulation[harmonic] * prevFftData[harmonic];
+            mMagnitudes[harmonic] = static_cast<float>(std::abs(overlapped));
+        }
+
+        // Add magnitude of coefficient (roughly energy in this frequency)
+        // of the FFT of overlapped windows to the appropriate bin.
+        mBinMap.apply(mMagnitudes.data(), bands);
+        return true;
+    }
+
+    // Forgets the previous window, for when the next one doesn't follow on from it.
+    void reset() {
+        auto &prevFftData = mFftBuffers[mCurrent ^ 1];
+        std::fill(prevFftData.begin(), prevFftData.end(), std::complex<double>{});
+    }
+
+  private:
+    dsp::BinMap mBinMap;
+    std::array<std::complex<double>, NUM_FFT_BINS> mModulation{};
+    std::array<float, NUM_FFT_BINS> mMagnitudes{};
+
+    static constexpr const auto &HANN_WINDOW = dsp::WINDOW_TABLE<dsp::WindowType::Hann, FFT_LEN>;
+    kfr::dft_plan_real<double> mPlan;
+    kfr::univector<cometa::u8> mTemp;
+    kfr::univector<double, FFT_LEN> mInData = {0.0};
+
+    std::array<kfr::univector<std::complex<double>, FFT_LEN>, 2> mFftBuffers{};
+    size_t mCurrent = 0;
+};
+
+// ---------------------------
+// Float STFT engine.
+
+template <size_t WINDOW_SIZE, size_t FFT_SIZE = proc_thread::STFT_FFT_SIZE,
+          size_t HOP = proc_thread::STFT_HOP, dsp::WindowType WINDOW = proc_thread::STFT_WINDOW>
+class FloatSpectrumEngine {
+    using Stft = dsp::Stft<FFT_SIZE, HOP, WINDOW>;
+
+  public:
+    static constexpr size_t FFT_LEN = FFT_SIZE;
+    // Unique bins of a real FFT: DC through Nyquist.
+    static constexpr size_t NUM_FFT_BINS = Stft::NUM_BINS;
+    // Band level of a full-scale sine: its main lobe, counting negative frequencies.
+    static constexpr float FULL_SCALE_LEVEL = FFT_LEN * Stft::NORMALIZATION.mainLobeGain;
+
+    explicit FloatSpectrumEngine(uint32_t sampleRate,
+                                 proc_thread::BandEdgeSpan bandEdges = proc_thread::BIN_EDGES,
+                                 dsp::BinWeighting weighting = dsp::BinWeighting::Nearest)
+        : mBinMap(bandEdges, FFT_LEN, sampleRate, weighting) {
+    }
+
+    [[nodiscard]] size_t numBands() const {
+        return mBinMap.numBands();
+    }
+
+    // Writes numBands() band levels, averaged over the STFT frames this window
+    // completes. Returns false if it completed none, which happens when the
+    // hop is longer than a window.
+    bool process(const float *windowData, float *bands) {
+        mMagnitudes.fill(0.0f);
+        size_t numFrames = 0;
+
+        mStft.push(windowData, WINDOW_SIZE, [this, &numFrames](Stft::Spectrum spectrum) {
+            // Count the matching negative frequency too, as the double engine does.
+            // DC and Nyquist have none.
+            for (size_t harmonic = 0; harmonic < NUM_FFT_BINS; harmonic++) {
+                float scale = harmonic == 0 || harmonic == NUM_FFT_BINS - 1 ? 1.0f : 2.0f;
+                mMagnitudes[harmonic] += scale * std::abs(spectrum[harmonic]);
+            }
+            numFrames++;
+        });
+        if (numFrames == 0) {
+            return false;
+        }
+
+        mBinMap.apply(mMagnitudes.data(), bands);
+        float invFrames = 1.0f / static_cast<float>(numFrames);
+        for (size_t band = 0; band < numBands(); band++) {
+            bands[band] *= invFrames;
+        }
+        return true;
+    }
+
+    // Forgets the samples buffered for the next STFT frame, for when the next
+    // window doesn't follow on from them.
+    void reset() {
+        mStft.reset();
+    }
+
+  private:
+    dsp::BinMap mBinMap;
+    Stft mStft;
+    std::array<float, NUM_FFT_BINS> mMagnitudes{};
+};
+
+#endif // SPECTRUM_ENGINE_H_
@@ -20,6 +20,8 @@ CursesConsole::CursesConsole() {
     noecho();
     // Allow capturing special keys.
     keypad(mScr, TRUE);
+    // Allow using the terminal's insert and delete line features for scrolling.
+    idlok(mScr, TRUE);
 
     // Initialize colors.
     start_color();
@@ -79,6 +81,24 @@ void CursesConsole::writeBuffer() {
 
 void CursesConsole::clearBuffer() {
     wclear(mScr);
+    mClearCount++;
+}
+
+std::uint64_t CursesConsole::clearCount() const {
+    return mClearCount;
+}
+
+void CursesConsole::scrollLines(int top, int bottom, int lines) {
+    int rows = getScreenSize().first;
+    if (top < 0 || bottom >= rows || top > bottom) {
+        return;
+    }
+    wsetscrreg(mScr, top, bottom);
+    scrollok(mScr, TRUE);
+    // Positive counts scroll text up in curses.
+    wscrl(mScr, -lines);
+    scrollok(mScr, FALSE);
+    wsetscrreg(mScr, 0, rows - 1);
 }
 
 void CursesConsole::moveCursor(int x, int y) {
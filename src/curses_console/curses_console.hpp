@@ -25,6 +25,8 @@ typedef struct _win_st WINDOW;
 #define CURSES_KEY_d 0x64
 #define CURSES_KEY_f 0x66
 #define CURSES_KEY_l 0x6C
+#define CURSES_KEY_m 0x6D
+#define CURSES_KEY_n 0x6E
 #define CURSES_KEY_p 0x70
 #define CURSES_KEY_q 0x71
 #define CURSES_KEY_s 0x73
@@ -78,6 +80,15 @@ class CursesConsole {
 
     void clearBuffer();
 
+    // Number of clearBuffer() calls so far, so views that draw incrementally
+    // know when they have to draw everything again.
+    [[nodiscard]] std::uint64_t clearCount() const;
+
+    // Moves lines top through bottom down by the given number of lines, or up
+    // if it is negative. Lines scrolled in are blank. This lets the terminal
+    // scroll the region itself instead of us rewriting every line.
+    void scrollLines(int top, int bottom, int lines);
+
     void moveCursor(int x, int y);
 
     void addChar(char ch);
@@ -101,6 +112,7 @@ class CursesConsole {
   private:
     WINDOW *mScr;
     int mLastBlockingTime = INFINITE_BLOCKING;
+    std::uint64_t mClearCount = 0;
 
     static constexpr std::size_t GET_STRING_BUFFER_SIZE = 1024;
 };
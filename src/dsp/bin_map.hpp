@@ -0,0 +1,125 @@
+#ifndef BIN_MAP_H_
+#define BIN_MAP_H_
+
+#include <dsp/simd_lanes.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace dsp {
+
+enum class BinWeighting {
+    // Each FFT bin goes entirely to the band containing its center frequency,
+    // with band edges inclusive at the top.
+    Nearest,
+    // Each FFT bin covers the frequencies within half a bin of its center, and
+    // is split between bands in proportion to how much of that range falls in
+    // each. Needed when bands are narrower than the FFT bin spacing.
+    Fractional,
+};
+
+// Reduces FFT magnitudes to display bands using a table built once per
+// sample rate, so the per-frame pass does no frequency arithmetic.
+//
+// The FFT bins feeding a band are always contiguous, so each band stores
+// a span of bins and a matching run of weights, and a band level is the
+// dot product of the two. That is branch free and runs in FloatLanes, and
+// its cost depends on the number of FFT bins, not on the number of bands.
+class BinMap {
+  public:
+    BinMap() = default;
+
+    // Bands lie between consecutive ascending edges in Hz, so there is one
+    // band fewer than edges. FFT bins outside the outer edges are ignored.
+    BinMap(std::span<const double> bandEdgesHz, size_t fftLen, double sampleRate,
+           BinWeighting weighting = BinWeighting::Nearest) {
+        size_t numFftBins = fftLen / 2 + 1;
+        double binWidth = sampleRate / static_cast<double>(fftLen);
+        size_t numBands = bandEdgesHz.size() > 1 ? bandEdgesHz.size() - 1 : 0;
+        mBands.reserve(numBands);
+
+        for (size_t band = 0; band < numBands; band++) {
+            double low = bandEdgesHz[band];
+            double high = bandEdgesHz[band + 1];
+
+            BandSpan span{0, 0, static_cast<uint32_t>(mWeights.size())};
+            for (size_t bin = 0; bin < numFftBins; bin++) {
+                float weight = binWeight(bin * binWidth, binWidth, low, high, band == 0,
+                                         weighting);
+                if (weight == 0.0f) {
+                    continue;
+                }
+                if (span.numBins == 0) {
+                    span.firstBin = static_cast<uint32_t>(bin);
+                }
+                // Fill any gap so the weights stay aligned with the bins.
+                while (span.firstBin + span.numBins < bin) {
+                    mWeights.push_back(0.0f);
+                    span.numBins++;
+                }
+                mWeights.push_back(weight);
+                span.numBins++;
+            }
+            mBands.push_back(span);
+        }
+    }
+
+    [[nodiscard]] size_t numBands() const {
+        return mBands.size();
+    }
+
+    // Number of (FFT bin, band) pairs in the table.
+    [[nodiscard]] size_t numEntries() const {
+        return mWeights.size();
+    }
+
+    // Writes numBands() levels to bands from an array of FFT bin magnitudes.
+    void apply(const float *magnitudes, float *bands) const {
+        constexpr size_t LANES = FloatLanes::NUM_LANES;
+
+        for (size_t band = 0; band < mBands.size(); band++) {
+            const BandSpan &span = mBands[band];
+            const float *weights = mWeights.data() + span.weightOffset;
+            const float *mags = magnitudes + span.firstBin;
+
+            FloatLanes acc = FloatLanes::zero();
+            size_t i = 0;
+            for (; i + LANES <= span.numBins; i += LANES) {
+                acc = acc + FloatLanes::load(weights + i) * FloatLanes::load(mags + i);
+            }
+            float level = acc.sum();
+            for (; i < span.numBins; i++) {
+                level += weights[i] * mags[i];
+            }
+            bands[band] = level;
+        }
+    }
+
+  private:
+    struct BandSpan {
+        uint32_t firstBin;
+        uint32_t numBins;
+        uint32_t weightOffset;
+    };
+
+    static float binWeight(double center, double binWidth, double low, double high,
+                           bool firstBand, BinWeighting weighting) {
+        if (weighting == BinWeighting::Nearest) {
+            bool inBand = (firstBand ? center >= low : center > low) && center <= high;
+            return inBand ? 1.0f : 0.0f;
+        }
+        double overlap = std::min(center + binWidth / 2, high) -
+                         std::max(center - binWidth / 2, low);
+        return overlap > 0.0 ? static_cast<float>(overlap / binWidth) : 0.0f;
+    }
+
+    std::vector<BandSpan> mBands;
+    std::vector<float> mWeights;
+};
+
+} // namespace dsp
+
+#endif // BIN_MAP_H_
@@ -0,0 +1,94 @@
+#ifndef BIQUAD_H_
+#define BIQUAD_H_
+
+#include "simd_lanes.hpp"
+
+#include <array>
+#include <cstddef>
+
+namespace dsp {
+
+// Coefficients of one second-order section, normalized so that a0 = 1:
+//
+//   H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+//
+// These match the rows of the "sos" arrays that SciPy produces.
+struct BiquadCoeffs {
+    float b0 = 1.0f;
+    float b1 = 0.0f;
+    float b2 = 0.0f;
+    float a1 = 0.0f;
+    float a2 = 0.0f;
+};
+
+// A cascade of second-order sections in transposed direct form II.
+//
+// Splitting a high-order IIR filter into biquads keeps each section's poles
+// well conditioned, so unlike a single high-order direct form polynomial it
+// stays accurate in float32. TDF-II needs only two state values per section.
+//
+// The channels of a frame are filtered together, one channel per SIMD lane,
+// so up to FloatLanes::NUM_LANES channels cost the same instruction stream.
+// There is no dependency between lanes, so this vectorizes where filtering
+// the samples of one channel (each depending on the last) cannot.
+template <size_t NUM_SECTIONS>
+class SosFilter {
+  public:
+    using Sections = std::array<BiquadCoeffs, NUM_SECTIONS>;
+
+    static constexpr size_t MAX_CHANNELS = FloatLanes::NUM_LANES;
+
+    explicit SosFilter(const Sections &sections) {
+        setSections(sections);
+    }
+
+    void setSections(const Sections &sections) {
+        for (size_t s = 0; s < NUM_SECTIONS; s++) {
+            mCoeffs[s] = {
+                .b0 = FloatLanes::splat(sections[s].b0),
+                .b1 = FloatLanes::splat(sections[s].b1),
+                .b2 = FloatLanes::splat(sections[s].b2),
+                .a1 = FloatLanes::splat(sections[s].a1),
+                .a2 = FloatLanes::splat(sections[s].a2),
+            };
+        }
+    }
+
+    void reset() {
+        for (auto &state : mState) {
+            state = {FloatLanes::zero(), FloatLanes::zero()};
+        }
+    }
+
+    // Filters one frame, with one channel in each lane.
+    FloatLanes process(FloatLanes x) {
+        for (size_t s = 0; s < NUM_SECTIONS; s++) {
+            const LaneCoeffs &c = mCoeffs[s];
+            SectionState &state = mState[s];
+
+            FloatLanes y = c.b0 * x + state.z1;
+            state.z1 = c.b1 * x - c.a1 * y + state.z2;
+            state.z2 = c.b2 * x - c.a2 * y;
+            x = y;
+        }
+        return x;
+    }
+
+  private:
+    // Coefficients broadcast to every lane, so the loop does no shuffling.
+    struct LaneCoeffs {
+        FloatLanes b0, b1, b2, a1, a2;
+    };
+
+    struct SectionState {
+        FloatLanes z1 = FloatLanes::zero();
+        FloatLanes z2 = FloatLanes::zero();
+    };
+
+    std::array<LaneCoeffs, NUM_SECTIONS> mCoeffs;
+    std::array<SectionState, NUM_SECTIONS> mState{};
+};
+
+} // namespace dsp
+
+#endif // BIQUAD_H_
@@ -0,0 +1,158 @@
+#ifndef CONSTEXPR_MATH_H_
+#define CONSTEXPR_MATH_H_
+
+// Math functions that can be evaluated at compile time, so that filter
+// designs and windows for fixed parameters can be baked into tables.
+//
+// The <cmath> functions aren't constexpr in the compilers we use, so in
+// constant evaluation these use series expansions accurate to about double
+// precision for the arguments we need. At runtime they call <cmath>.
+
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+
+namespace dsp::cmath {
+
+namespace detail {
+
+// Taylor series for |x| <= pi/4.
+constexpr double sinSeries(double x) {
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cosSeries(double x) {
+    double term = 1.0;
+    double sum = 1.0;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n - 1) * (2 * n));
+        sum += term;
+    }
+    return sum;
+}
+
+// Splits x into k pi/2 + r with |r| <= pi/4, and returns k mod 4.
+constexpr int reduceQuarterPi(double x, double &r) {
+    constexpr double HALF_PI = std::numbers::pi / 2.0;
+    double k = x / HALF_PI;
+    auto kRounded = static_cast<int64_t>(k >= 0.0 ? k + 0.5 : k - 0.5);
+    r = x - static_cast<double>(kRounded) * HALF_PI;
+    return static_cast<int>(((kRounded % 4) + 4) % 4);
+}
+
+} // namespace detail
+
+constexpr double sin(double x) {
+    if !consteval {
+        return std::sin(x);
+    }
+    double r = 0.0;
+    switch (detail::reduceQuarterPi(x, r)) {
+    case 0:
+        return detail::sinSeries(r);
+    case 1:
+        return detail::cosSeries(r);
+    case 2:
+        return -detail::sinSeries(r);
+    default:
+        return -detail::cosSeries(r);
+    }
+}
+
+constexpr double cos(double x) {
+    if !consteval {
+        return std::cos(x);
+    }
+    double r = 0.0;
+    switch (detail::reduceQuarterPi(x, r)) {
+    case 0:
+        return detail::cosSeries(r);
+    case 1:
+        return -detail::sinSeries(r);
+    case 2:
+        return -detail::cosSeries(r);
+    default:
+        return detail::sinSeries(r);
+    }
+}
+
+constexpr double tan(double x) {
+    if !consteval {
+        return std::tan(x);
+    }
+    return sin(x) / cos(x);
+}
+
+constexpr double sqrt(double x) {
+    if !consteval {
+        return std::sqrt(x);
+    }
+    if (x <= 0.0) {
+        return 0.0;
+    }
+    // Newton's method, starting above the root so it decreases monotonically.
+    double guess = x > 1.0 ? x : 1.0;
+    for (int i = 0; i < 100; i++) {
+        double next = 0.5 * (guess + x / guess);
+        if (next >= guess) {
+            break;
+        }
+        guess = next;
+    }
+    return guess;
+}
+
+constexpr double exp(double x) {
+    if !consteval {
+        return std::exp(x);
+    }
+    // Split x into k ln(2) + r with |r| <= ln(2) / 2, so the series converges fast.
+    double k = x / std::numbers::ln2;
+    auto kRounded = static_cast<int64_t>(k >= 0.0 ? k + 0.5 : k - 0.5);
+    double r = x - static_cast<double>(kRounded) * std::numbers::ln2;
+
+    double term = 1.0;
+    double sum = 1.0;
+    for (int n = 1; n < 20; n++) {
+        term *= r / n;
+        sum += term;
+    }
+
+    double scale = kRounded >= 0 ? 2.0 : 0.5;
+    for (int64_t i = 0; i < (kRounded >= 0 ? kRounded : -kRounded); i++) {
+        sum *= scale;
+    }
+    return sum;
+}
+
+// 10^x, as used for decibel conversions.
+constexpr double pow10(double x) {
+    return exp(x * std::numbers::ln10);
+}
+
+// Modified Bessel function of the first kind, order zero, as used by the
+// Kaiser window. There is no <cmath> version in libc++, so this always uses
+// the power series, which converges quickly for the arguments windows use.
+constexpr double besselI0(double x) {
+    double term = 1.0;
+    double sum = 1.0;
+    double halfX = x / 2.0;
+    for (int k = 1; k < 100; k++) {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+        if (term < sum * 1e-17) {
+            break;
+        }
+    }
+    return sum;
+}
+
+} // namespace dsp::cmath
+
+#endif // CONSTEXPR_MATH_H_
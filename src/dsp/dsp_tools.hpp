@@ -1,6 +1,8 @@
 #ifndef DSP_TOOLS_H_
 #define DSP_TOOLS_H_
 
+#include <dsp/constexpr_math.hpp>
+
 #include <array>
 #include <cmath>
 #include <cstddef>
@@ -8,17 +10,164 @@
 
 namespace dsp {
 
-template <size_t WINDOW_SIZE>
-static std::array<double, WINDOW_SIZE> makeHannWindow() {
-    std::array<double, WINDOW_SIZE> window{};
-    double PI = std::numbers::pi_v<double>;
-    for (size_t i = 0; i < WINDOW_SIZE; i++) {
-        double sinTerm = std::sin(PI * i / static_cast<double>(WINDOW_SIZE));
-        window[i] = sinTerm * sinTerm;
+// -----------------
+// Window functions.
+
+// Tables of windows are computed at compile time and live in read-only data,
+// so using one costs nothing at startup. Each comes with the normalization
+// constants an analyzer needs to read magnitudes correctly.
+
+enum class WindowType {
+    Hann,
+    // Lower nearest sidelobe than Hann, but sidelobes fall off slowly.
+    Hamming,
+    // Four-term Blackman-Harris: sidelobes below -92 dB, with a wider main lobe.
+    BlackmanHarris,
+    // Tradeoff between main lobe width and sidelobe level set by beta.
+    Kaiser,
+};
+
+inline const char *windowTypeString(WindowType type) {
+    switch (type) {
+    case WindowType::Hamming:
+        return "hamming";
+    case WindowType::BlackmanHarris:
+        return "blackman-harris";
+    case WindowType::Kaiser:
+        return "kaiser";
+    default:
+        return "hann";
+    }
+}
+
+// Sidelobes around -60 dB, a little better than Hann with a similar main lobe.
+static constexpr double KAISER_BETA = 8.6;
+
+// Coefficients a_k of the cosine-sum windows, sum of (-1)^k a_k cos(k x).
+// Kaiser isn't one, and has none.
+constexpr std::array<double, 4> cosineSumCoefficients(WindowType type) {
+    switch (type) {
+    case WindowType::Hann:
+        return {0.5, 0.5, 0.0, 0.0};
+    case WindowType::Hamming:
+        return {0.54, 0.46, 0.0, 0.0};
+    case WindowType::BlackmanHarris:
+        return {0.35875, 0.48829, 0.14128, 0.01168};
+    default:
+        return {};
+    }
+}
+
+// Periodic windows, as used for spectral analysis: the length N window is
+// the first N points of a symmetric window of length N + 1, so overlapping
+// copies at the right hops add up to a constant.
+//
+// This only uses dsp::cmath, so a window with constant arguments can be
+// computed at compile time into a table.
+template <typename T, size_t N>
+constexpr std::array<T, N> makeWindow(WindowType type, double kaiserBeta = KAISER_BETA) {
+    std::array<T, N> window{};
+    for (size_t i = 0; i < N; i++) {
+        double phase = 2.0 * std::numbers::pi * static_cast<double>(i) / static_cast<double>(N);
+        // cos(2x) and cos(3x) from cos(x), so each point costs one cosine.
+        double c1 = cmath::cos(phase);
+        double c2 = 2.0 * c1 * c1 - 1.0;
+        double c3 = (4.0 * c1 * c1 - 3.0) * c1;
+
+        double value = 0.0;
+        if (type == WindowType::Kaiser) {
+            double x = (2.0 * static_cast<double>(i) - static_cast<double>(N)) /
+                       static_cast<double>(N);
+            value = cmath::besselI0(kaiserBeta * cmath::sqrt(1.0 - x * x)) /
+                    cmath::besselI0(kaiserBeta);
+        } else {
+            std::array<double, 4> a = cosineSumCoefficients(type);
+            value = a[0] - a[1] * c1 + a[2] * c2 - a[3] * c3;
+        }
+        window[i] = static_cast<T>(value);
     }
     return window;
 }
 
+// Compile-time table of a window, e.g. WINDOW_TABLE<WindowType::Hann, 512>.
+template <WindowType TYPE, size_t N, typename T = double>
+inline constexpr std::array<T, N> WINDOW_TABLE = makeWindow<T, N>(TYPE);
+
+struct WindowNormalization {
+    // Mean of the window. A sine of amplitude A has a peak FFT magnitude of
+    // A * N * coherentGain / 2.
+    double coherentGain;
+    // Equivalent noise bandwidth in bins: the width of a rectangular filter
+    // passing the same white noise power. Divide a power spectrum by this to
+    // read noise densities.
+    double enbw;
+    // Sum of the window's DFT magnitudes over its main lobe, over N. The bins of
+    // a sine of amplitude A, centered on a bin, have magnitudes summing to
+    // A * N * mainLobeGain, counting negative frequencies.
+    double mainLobeGain;
+};
+
+// Magnitude of the Kaiser window's transform m bins from the center, relative
+// to the center, from the continuous transform sinh(sqrt(beta^2 - (pi m)^2)) /
+// sqrt(beta^2 - (pi m)^2). That is close to the DFT for any practical length.
+constexpr double kaiserBinRatio(double m, double kaiserBeta) {
+    auto shape = [](double beta, double m) {
+        double z = beta * beta - std::numbers::pi * std::numbers::pi * m * m;
+        if (z == 0.0) {
+            return 1.0;
+        }
+        if (z < 0.0) {
+            double s = cmath::sqrt(-z);
+            return cmath::sin(s) / s;
+        }
+        double s = cmath::sqrt(z);
+        return (cmath::exp(s) - cmath::exp(-s)) / (2.0 * s);
+    };
+    double ratio = shape(kaiserBeta, m) / shape(kaiserBeta, 0.0);
+    return ratio < 0.0 ? -ratio : ratio;
+}
+
+// For a cosine-sum window the DFT is N * a_0 at DC and N * a_k / 2 at k bins
+// either side, so the main lobe sums to N times the sum of the |a_k|. For
+// Kaiser, sums the bins inside the first nulls, at sqrt(1 + (beta / pi)^2).
+constexpr double mainLobeGain(WindowType type, double coherentGain,
+                              double kaiserBeta = KAISER_BETA) {
+    double gain = 0.0;
+    if (type == WindowType::Kaiser) {
+        double betaOverPi = kaiserBeta / std::numbers::pi;
+        auto halfWidth = static_cast<int>(cmath::sqrt(1.0 + betaOverPi * betaOverPi));
+        for (int m = -halfWidth; m <= halfWidth; m++) {
+            gain += kaiserBinRatio(m, kaiserBeta);
+        }
+        return coherentGain * gain;
+    }
+    for (double a : cosineSumCoefficients(type)) {
+        gain += a < 0.0 ? -a : a;
+    }
+    return gain;
+}
+
+template <typename T, size_t N>
+constexpr WindowNormalization windowNormalization(WindowType type,
+                                                  const std::array<T, N> &window) {
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    for (T value : window) {
+        sum += static_cast<double>(value);
+        sumSquares += static_cast<double>(value) * static_cast<double>(value);
+    }
+    double coherentGain = sum / static_cast<double>(N);
+    return {
+        .coherentGain = coherentGain,
+        .enbw = static_cast<double>(N) * sumSquares / (sum * sum),
+        .mainLobeGain = mainLobeGain(type, coherentGain),
+    };
+}
+
+template <WindowType TYPE, size_t N>
+inline constexpr WindowNormalization WINDOW_NORMALIZATION =
+    windowNormalization(TYPE, WINDOW_TABLE<TYPE, N>);
+
 } // namespace dsp
 
 #endif // DSP_TOOLS_H_
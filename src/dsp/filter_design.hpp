@@ -0,0 +1,121 @@
+#ifndef FILTER_DESIGN_H_
+#define FILTER_DESIGN_H_
+
+// Filter designs as second-order sections: shelves and peaking filters from
+// Robert Bristow-Johnson's "Audio EQ Cookbook", and Butterworth lowpasses.
+//
+// These are computed in double precision and rounded to float only at the
+// end, since the coefficients of low-frequency sections are close to the
+// values where the poles would reach the unit circle. Everything is constexpr,
+// so designs for fixed sample rates can be made at compile time.
+
+#include "biquad.hpp"
+#include "constexpr_math.hpp"
+
+#include <array>
+#include <cstddef>
+#include <numbers>
+
+namespace dsp {
+
+// Q giving the steepest shelf slope without overshoot (shelf slope S = 1).
+static constexpr double SHELF_Q = std::numbers::sqrt2 / 2.0;
+
+namespace detail {
+
+struct CookbookTerms {
+    double A;
+    double cosW0;
+    double alpha;
+};
+
+constexpr CookbookTerms cookbookTerms(double sampleRate, double f0, double q, double gainDb) {
+    double w0 = 2.0 * std::numbers::pi * f0 / sampleRate;
+    return {
+        .A = cmath::pow10(gainDb / 40.0),
+        .cosW0 = cmath::cos(w0),
+        .alpha = cmath::sin(w0) / (2.0 * q),
+    };
+}
+
+constexpr BiquadCoeffs normalize(double b0, double b1, double b2, double a0, double a1, double a2) {
+    return {
+        .b0 = static_cast<float>(b0 / a0),
+        .b1 = static_cast<float>(b1 / a0),
+        .b2 = static_cast<float>(b2 / a0),
+        .a1 = static_cast<float>(a1 / a0),
+        .a2 = static_cast<float>(a2 / a0),
+    };
+}
+
+} // namespace detail
+
+// Boosts or cuts a band around f0 by gainDb, with bandwidth set by q.
+constexpr BiquadCoeffs peakingEq(double sampleRate, double f0, double q, double gainDb) {
+    auto [A, cosW0, alpha] = detail::cookbookTerms(sampleRate, f0, q, gainDb);
+
+    return detail::normalize(1.0 + alpha * A, -2.0 * cosW0, 1.0 - alpha * A, //
+                             1.0 + alpha / A, -2.0 * cosW0, 1.0 - alpha / A);
+}
+
+// Boosts or cuts everything below f0 by gainDb.
+constexpr BiquadCoeffs lowShelf(double sampleRate, double f0, double q, double gainDb) {
+    auto [A, cosW0, alpha] = detail::cookbookTerms(sampleRate, f0, q, gainDb);
+    double sqrtTerm = 2.0 * cmath::sqrt(A) * alpha;
+
+    return detail::normalize(A * ((A + 1.0) - (A - 1.0) * cosW0 + sqrtTerm),
+                             2.0 * A * ((A - 1.0) - (A + 1.0) * cosW0),
+                             A * ((A + 1.0) - (A - 1.0) * cosW0 - sqrtTerm),
+                             (A + 1.0) + (A - 1.0) * cosW0 + sqrtTerm,
+                             -2.0 * ((A - 1.0) + (A + 1.0) * cosW0),
+                             (A + 1.0) + (A - 1.0) * cosW0 - sqrtTerm);
+}
+
+// Boosts or cuts everything above f0 by gainDb.
+constexpr BiquadCoeffs highShelf(double sampleRate, double f0, double q, double gainDb) {
+    auto [A, cosW0, alpha] = detail::cookbookTerms(sampleRate, f0, q, gainDb);
+    double sqrtTerm = 2.0 * cmath::sqrt(A) * alpha;
+
+    return detail::normalize(A * ((A + 1.0) + (A - 1.0) * cosW0 + sqrtTerm),
+                             -2.0 * A * ((A - 1.0) + (A + 1.0) * cosW0),
+                             A * ((A + 1.0) + (A - 1.0) * cosW0 - sqrtTerm),
+                             (A + 1.0) - (A - 1.0) * cosW0 + sqrtTerm,
+                             2.0 * ((A - 1.0) - (A + 1.0) * cosW0),
+                             (A + 1.0) - (A - 1.0) * cosW0 - sqrtTerm);
+}
+
+// Butterworth lowpass of the given order with its -3 dB point at cutoff,
+// by the bilinear transform with the cutoff prewarped. Each pair of analog
+// poles becomes one section, and for odd orders the first section holds the
+// single real pole, with b2 and a2 zero.
+template <std::size_t ORDER>
+constexpr std::array<BiquadCoeffs, (ORDER + 1) / 2> butterworthLowpass(double sampleRate,
+                                                                        double cutoff) {
+    static_assert(ORDER > 0);
+    std::array<BiquadCoeffs, (ORDER + 1) / 2> sections{};
+
+    double K = cmath::tan(std::numbers::pi * cutoff / sampleRate);
+    std::size_t section = 0;
+
+    if constexpr (ORDER % 2 == 1) {
+        // H(s) = 1 / (s + 1)
+        sections[section++] = detail::normalize(K, K, 0.0, K + 1.0, K - 1.0, 0.0);
+    }
+
+    for (std::size_t k = 0; k < ORDER / 2; k++) {
+        // H(s) = 1 / (s^2 + 2 zeta s + 1), with the analog poles
+        // equally spaced on the left half of the unit circle.
+        double zeta = cmath::sin(std::numbers::pi * (2 * k + 1) / (2.0 * ORDER));
+        double KK = K * K;
+
+        sections[section++] = detail::normalize(KK, 2.0 * KK, KK, //
+                                                1.0 + 2.0 * zeta * K + KK, 2.0 * (KK - 1.0),
+                                                1.0 - 2.0 * zeta * K + KK);
+    }
+
+    return sections;
+}
+
+} // namespace dsp
+
+#endif // FILTER_DESIGN_H_
@@ -0,0 +1,98 @@
+#ifndef PARAM_RAMP_H_
+#define PARAM_RAMP_H_
+
+#include <cmath>
+#include <cstddef>
+
+namespace dsp {
+
+enum class RampShape {
+    // Constant rate of change, reaching the target exactly.
+    Linear,
+    // Covers a fixed fraction of the remaining distance each frame, like a
+    // one-pole smoother, and snaps to the target when the ramp ends. Sounds
+    // more natural for gains in decibels.
+    Exponential,
+};
+
+// A parameter that moves to a new value over a fixed number of frames
+// instead of jumping there, which would click.
+//
+// Callers check isRamping() once per block and use value() in a loop
+// specialized for a constant parameter when it is false, so the common
+// case costs nothing per frame. While ramping, next() advances by one
+// frame; both shapes are the same recurrence value = value * a + b.
+class ParamRamp {
+  public:
+    explicit ParamRamp(float value = 0.0f, std::size_t rampFrames = 1,
+                       RampShape shape = RampShape::Linear)
+        : mValue(value),
+          mTarget(value),
+          mRampFrames(rampFrames > 0 ? rampFrames : 1),
+          mShape(shape) {
+    }
+
+    // Starts a ramp from the current value. Does nothing if the target is unchanged.
+    void setTarget(float target) {
+        if (target == mTarget) {
+            return;
+        }
+        mTarget = target;
+        mRemaining = mRampFrames;
+
+        if (mShape == RampShape::Linear) {
+            mScale = 1.0f;
+            mOffset = (target - mValue) / static_cast<float>(mRampFrames);
+        } else {
+            // Get within about -60 dB of the target by the end of the ramp.
+            constexpr float REMAINING_FRACTION = 0.001f;
+            mScale = std::pow(REMAINING_FRACTION, 1.0f / static_cast<float>(mRampFrames));
+            mOffset = target * (1.0f - mScale);
+        }
+    }
+
+    // Jumps straight to the value, e.g. before playback starts.
+    void reset(float value) {
+        mValue = value;
+        mTarget = value;
+        mRemaining = 0;
+    }
+
+    [[nodiscard]] bool isRamping() const {
+        return mRemaining > 0;
+    }
+
+    [[nodiscard]] std::size_t remainingFrames() const {
+        return mRemaining;
+    }
+
+    [[nodiscard]] float value() const {
+        return mValue;
+    }
+
+    [[nodiscard]] float target() const {
+        return mTarget;
+    }
+
+    // Advances one frame and returns the new value. Only valid while ramping.
+    float next() {
+        mValue = --mRemaining == 0 ? mTarget : mValue * mScale + mOffset;
+        return mValue;
+    }
+
+  private:
+    float mValue;
+    float mTarget;
+
+    std::size_t mRampFrames;
+    std::size_t mRemaining = 0;
+    RampShape mShape;
+
+    // Per-frame recurrence for the current ramp.
+    float mScale = 1.0f;
+    float mOffset = 0.0f;
+};
+
+} // namespace dsp
+
+#endif // PARAM_RAMP_H_
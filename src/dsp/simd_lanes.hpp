@@ -0,0 +1,178 @@
+#ifndef SIMD_LANES_H_
+#define SIMD_LANES_H_
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dsp {
+
+// Eight float lanes with elementwise arithmetic. This uses one AVX register
+// when compiled with AVX support (e.g. -mavx2 or -march=native), a pair of
+// SSE registers on other x86-64 builds, and plain arrays elsewhere.
+struct FloatLanes {
+    static constexpr size_t NUM_LANES = 8;
+
+#if defined(__AVX__)
+    __m256 v;
+
+    static FloatLanes load(const float *ptr) {
+        return {_mm256_loadu_ps(ptr)};
+    }
+    static FloatLanes splat(float x) {
+        return {_mm256_set1_ps(x)};
+    }
+    void store(float *ptr) const {
+        _mm256_storeu_ps(ptr, v);
+    }
+    friend FloatLanes operator+(FloatLanes a, FloatLanes b) {
+        return {_mm256_add_ps(a.v, b.v)};
+    }
+    friend FloatLanes operator-(FloatLanes a, FloatLanes b) {
+        return {_mm256_sub_ps(a.v, b.v)};
+    }
+    friend FloatLanes operator*(FloatLanes a, FloatLanes b) {
+        return {_mm256_mul_ps(a.v, b.v)};
+    }
+#elif defined(__SSE2__)
+    __m128 lo;
+    __m128 hi;
+
+    static FloatLanes load(const float *ptr) {
+        return {_mm_loadu_ps(ptr), _mm_loadu_ps(ptr + 4)};
+    }
+    static FloatLanes splat(float x) {
+        return {_mm_set1_ps(x), _mm_set1_ps(x)};
+    }
+    void store(float *ptr) const {
+        _mm_storeu_ps(ptr, lo);
+        _mm_storeu_ps(ptr + 4, hi);
+    }
+    friend FloatLanes operator+(FloatLanes a, FloatLanes b) {
+        return {_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)};
+    }
+    friend FloatLanes operator-(FloatLanes a, FloatLanes b) {
+        return {_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)};
+    }
+    friend FloatLanes operator*(FloatLanes a, FloatLanes b) {
+        return {_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)};
+    }
+#else
+    std::array<float, NUM_LANES> v;
+
+    static FloatLanes load(const float *ptr) {
+        FloatLanes lanes;
+        for (size_t i = 0; i < NUM_LANES; i++) {
+            lanes.v[i] = ptr[i];
+        }
+        return lanes;
+    }
+    static FloatLanes splat(float x) {
+        FloatLanes lanes;
+        lanes.v.fill(x);
+        return lanes;
+    }
+    void store(float *ptr) const {
+        for (size_t i = 0; i < NUM_LANES; i++) {
+            ptr[i] = v[i];
+        }
+    }
+    friend FloatLanes operator+(FloatLanes a, FloatLanes b) {
+        for (size_t i = 0; i < NUM_LANES; i++) {
+            a.v[i] += b.v[i];
+        }
+        return a;
+    }
+    friend FloatLanes operator-(FloatLanes a, FloatLanes b) {
+        for (size_t i = 0; i < NUM_LANES; i++) {
+            a.v[i] -= b.v[i];
+        }
+        return a;
+    }
+    friend FloatLanes operator*(FloatLanes a, FloatLanes b) {
+        for (size_t i = 0; i < NUM_LANES; i++) {
+            a.v[i] *= b.v[i];
+        }
+        return a;
+    }
+#endif
+
+    static FloatLanes zero() {
+        return splat(0.0f);
+    }
+
+    // Sum of all lanes.
+    [[nodiscard]] float sum() const {
+        alignas(32) float buffer[NUM_LANES];
+        store(buffer);
+        float total = 0.0f;
+        for (float value : buffer) {
+            total += value;
+        }
+        return total;
+    }
+
+    // Loads the first N lanes from memory and zeros the rest. N is a template
+    // parameter so the partial copy compiles down to fixed-size moves.
+    template <size_t N>
+    static FloatLanes loadPartial(const float *ptr) {
+        static_assert(N >= 1 && N <= NUM_LANES);
+        if constexpr (N == NUM_LANES) {
+            return load(ptr);
+        } else {
+            alignas(32) float buffer[NUM_LANES] = {};
+            for (size_t i = 0; i < N; i++) {
+                buffer[i] = ptr[i];
+            }
+            return load(buffer);
+        }
+    }
+
+    template <size_t N>
+    void storePartial(float *ptr) const {
+        static_assert(N >= 1 && N <= NUM_LANES);
+        if constexpr (N == NUM_LANES) {
+            store(ptr);
+        } else {
+            alignas(32) float buffer[NUM_LANES];
+            store(buffer);
+            for (size_t i = 0; i < N; i++) {
+                ptr[i] = buffer[i];
+            }
+        }
+    }
+};
+
+// Calls fn with the channel count as a std::integral_constant, so per-frame
+// code can be instantiated for each count that fits in the lanes.
+template <typename Fn>
+decltype(auto) withChannelCount(size_t numChannels, Fn &&fn) {
+    switch (numChannels) {
+    case 1:
+        return fn(std::integral_constant<size_t, 1>{});
+    case 2:
+        return fn(std::integral_constant<size_t, 2>{});
+    case 3:
+        return fn(std::integral_constant<size_t, 3>{});
+    case 4:
+        return fn(std::integral_constant<size_t, 4>{});
+    case 5:
+        return fn(std::integral_constant<size_t, 5>{});
+    case 6:
+        return fn(std::integral_constant<size_t, 6>{});
+    case 7:
+        return fn(std::integral_constant<size_t, 7>{});
+    default:
+        return fn(std::integral_constant<size_t, FloatLanes::NUM_LANES>{});
+    }
+}
+
+} // namespace dsp
+
+#endif // SIMD_LANES_H_
@@ -0,0 +1,91 @@
+#ifndef STFT_H_
+#define STFT_H_
+
+#include <dsp/dsp_tools.hpp>
+
+#include <kfr/dft/fft.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <complex>
+#include <cstddef>
+#include <span>
+
+namespace dsp {
+
+// Short-time Fourier transform of a stream of samples: every HOP samples,
+// the last FFT_SIZE samples are windowed and transformed with a float real
+// FFT, giving the FFT_SIZE / 2 + 1 bins from DC through Nyquist.
+//
+// The FFT size sets the frequency resolution and the latency, and the hop
+// sets how often frames come out; a hop of half the FFT size is 50% overlap.
+// The window is computed at compile time. Everything else is allocated by
+// the constructor, so push() can run on a thread that must not allocate.
+template <size_t FFT_SIZE, size_t HOP, WindowType WINDOW = WindowType::Hann>
+class Stft {
+  public:
+    static constexpr size_t NUM_BINS = FFT_SIZE / 2 + 1;
+
+    static_assert(std::has_single_bit(FFT_SIZE), "FFT size must be a power of two.");
+    static_assert(HOP > 0 && HOP <= FFT_SIZE, "Hop must be between 1 and the FFT size.");
+
+    static constexpr const std::array<float, FFT_SIZE> &WINDOW_TABLE =
+        dsp::WINDOW_TABLE<WINDOW, FFT_SIZE, float>;
+    static constexpr WindowNormalization NORMALIZATION = WINDOW_NORMALIZATION<WINDOW, FFT_SIZE>;
+
+    using Spectrum = std::span<const std::complex<float>, NUM_BINS>;
+
+    Stft()
+        : mPlan(FFT_SIZE),
+          mTemp(mPlan.temp_size) {
+    }
+
+    // Adds samples, and calls onFrame with the spectrum of each frame they
+    // complete. The spectrum is only valid during the call.
+    template <typename OnFrame>
+    void push(const float *samples, size_t count, OnFrame &&onFrame) {
+        while (count > 0) {
+            size_t take = std::min(count, FFT_SIZE - mFill);
+            std::copy_n(samples, take, mHistory.begin() + mFill);
+            mFill += take;
+            samples += take;
+            count -= take;
+
+            if (mFill == FFT_SIZE) {
+                onFrame(transform(mHistory.data()));
+                // Keep the overlap for the next frame.
+                std::copy(mHistory.begin() + HOP, mHistory.end(), mHistory.begin());
+                mFill = FFT_SIZE - HOP;
+            }
+        }
+    }
+
+    // Transforms one frame of FFT_SIZE samples, independent of the stream.
+    Spectrum transform(const float *frame) {
+        for (size_t i = 0; i < FFT_SIZE; i++) {
+            mInData[i] = WINDOW_TABLE[i] * frame[i];
+        }
+        mPlan.execute(mFftData.data(), mInData.data(), mTemp.data());
+        return Spectrum{mFftData.data(), NUM_BINS};
+    }
+
+    // Forgets buffered samples, e.g. when playback restarts.
+    void reset() {
+        mFill = 0;
+    }
+
+  private:
+    kfr::dft_plan_real<float> mPlan;
+    kfr::univector<cometa::u8> mTemp;
+    kfr::univector<float, FFT_SIZE> mInData = {0.0f};
+    kfr::univector<std::complex<float>, NUM_BINS> mFftData{};
+
+    // Most recent samples, oldest first.
+    std::array<float, FFT_SIZE> mHistory{};
+    size_t mFill = 0;
+};
+
+} // namespace dsp
+
+#endif // STFT_H_
@@ -0,0 +1,181 @@
+// Compares the double-precision spectrum engine with the float
+// power-of-two engine, for throughput and spectral accuracy.
+
+#include <audio_player/lib/spectrum_engine.hpp>
+
+#include <fmt/base.h>
+#include <fmt/core.h>
+#include <kfr/dft/fft.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <random>
+#include <vector>
+
+constexpr size_t WINDOW_SIZE = 512;
+constexpr uint32_t SAMPLE_RATE = 44'100;
+constexpr size_t NUM_WINDOWS = 20'000;
+
+// A few tones plus a little noise, one window after another.
+static std::vector<float> makeTestSignal(size_t numSamples) {
+    std::vector<float> signal(numSamples);
+    std::mt19937 rng{1234};
+    std::normal_distribution<float> noise{0.0f, 0.01f};
+
+    constexpr std::array<double, 4> TONES = {110.0, 440.0, 2'500.0, 7'000.0};
+    for (size_t i = 0; i < numSamples; i++) {
+        double t = static_cast<double>(i) / SAMPLE_RATE;
+        double sample = 0.0;
+        for (double freq : TONES) {
+            sample += 0.2 * std::sin(2.0 * std::numbers::pi * freq * t);
+        }
+        signal[i] = static_cast<float>(sample) + noise(rng);
+    }
+    return signal;
+}
+
+template <typename Engine>
+static double nsPerWindow(Engine &engine, const std::vector<float> &signal) {
+    proc_thread::SpectrumBins bins{};
+    float sink = 0.0f;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t w = 0; w < NUM_WINDOWS; w++) {
+        engine.process(signal.data() + w * WINDOW_SIZE, bins.data());
+        sink += bins[0];
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Keep the work from being optimized away.
+    if (sink == -1.0f) {
+        fmt::println("");
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / NUM_WINDOWS;
+}
+
+// Largest difference between float and double FFTs of the same
+// windowed input, in dB relative to the largest bin.
+static double floatFftErrorDb(const std::vector<float> &signal) {
+    constexpr size_t NUM_BINS = WINDOW_SIZE / 2 + 1;
+
+    kfr::dft_plan_real<float> floatPlan(WINDOW_SIZE);
+    kfr::dft_plan_real<double> doublePlan(WINDOW_SIZE);
+    kfr::univector<cometa::u8> floatTemp(floatPlan.temp_size);
+    kfr::univector<cometa::u8> doubleTemp(doublePlan.temp_size);
+
+    kfr::univector<float, WINDOW_SIZE> floatIn;
+    kfr::univector<double, WINDOW_SIZE> doubleIn;
+    kfr::univector<std::complex<float>, NUM_BINS> floatOut;
+    kfr::univector<std::complex<double>, NUM_BINS> doubleOut;
+
+    const auto &window = dsp::WINDOW_TABLE<dsp::WindowType::Hann, WINDOW_SIZE>;
+    for (size_t i = 0; i < WINDOW_SIZE; i++) {
+        floatIn[i] = static_cast<float>(window[i]) * signal[i];
+        doubleIn[i] = window[i] * signal[i];
+    }
+    floatPlan.execute(floatOut.data(), floatIn.data(), floatTemp.data());
+    doublePlan.execute(doubleOut.data(), doubleIn.data(), doubleTemp.data());
+
+    double peak = 0.0;
+    double maxError = 0.0;
+    for (size_t bin = 0; bin < NUM_BINS; bin++) {
+        std::complex<double> floatBin{floatOut[bin].real(), floatOut[bin].imag()};
+        peak = std::max(peak, std::abs(doubleOut[bin]));
+        maxError = std::max(maxError, std::abs(floatBin - doubleOut[bin]));
+    }
+    return 20.0 * std::log10(maxError / peak);
+}
+
+// Display bins as fractions of their total, which is what the level
+// meters show, so that the engines' different scales don't matter.
+template <typename Engine>
+static proc_thread::SpectrumBins normalizedBins(Engine &engine, const std::vector<float> &signal) {
+    proc_thread::SpectrumBins bins{};
+    // Run twice so the double engine's overlap has a previous window.
+    engine.process(signal.data(), bins.data());
+    engine.process(signal.data() + WINDOW_SIZE, bins.data());
+
+    float total = 0.0f;
+    for (float bin : bins) {
+        total += bin;
+    }
+    for (float &bin : bins) {
+        bin /= total;
+    }
+    return bins;
+}
+
+// Level of a full-scale sine centered on a bin, through the float engine with
+// the given window, in dB relative to its FULL_SCALE_LEVEL. Should be about 0.
+template <dsp::WindowType TYPE>
+static double fullScaleToneDb() {
+    using Engine = FloatSpectrumEngine<WINDOW_SIZE, WINDOW_SIZE, WINDOW_SIZE / 2, TYPE>;
+    // About 2 kHz, well inside one display bin.
+    constexpr size_t TONE_BIN = 24;
+    constexpr size_t NUM_TONE_WINDOWS = 4;
+
+    std::vector<float> tone(NUM_TONE_WINDOWS * WINDOW_SIZE);
+    for (size_t i = 0; i < tone.size(); i++) {
+        double phase = 2.0 * std::numbers::pi * TONE_BIN * static_cast<double>(i) / WINDOW_SIZE;
+        tone[i] = static_cast<float>(std::sin(phase));
+    }
+
+    Engine engine{SAMPLE_RATE};
+    proc_thread::SpectrumBins bins{};
+    for (size_t w = 0; w < NUM_TONE_WINDOWS; w++) {
+        engine.process(tone.data() + w * WINDOW_SIZE, bins.data());
+    }
+    float level = *std::max_element(bins.begin(), bins.end());
+    return 20.0 * std::log10(level / Engine::FULL_SCALE_LEVEL);
+}
+
+template <dsp::WindowType TYPE>
+static void printWindowNormalization() {
+    constexpr dsp::WindowNormalization norm = dsp::WINDOW_NORMALIZATION<TYPE, WINDOW_SIZE>;
+    fmt::println("  {:<16} coherent gain {:.4f}, ENBW {:.3f} bins, main lobe gain {:.4f}, "
+                 "full-scale sine {:+.2f} dB",
+                 dsp::windowTypeString(TYPE), norm.coherentGain, norm.enbw, norm.mainLobeGain,
+                 fullScaleToneDb<TYPE>());
+}
+
+int main() {
+    auto signal = makeTestSignal((NUM_WINDOWS + 1) * WINDOW_SIZE);
+
+    DoubleSpectrumEngine<WINDOW_SIZE> doubleEngine{SAMPLE_RATE};
+    FloatSpectrumEngine<WINDOW_SIZE> floatEngine{SAMPLE_RATE};
+
+    fmt::println("Windows of {} samples at {} Hz, {} windows per run.\n", WINDOW_SIZE,
+                 SAMPLE_RATE, NUM_WINDOWS);
+
+    double doubleNs = nsPerWindow(doubleEngine, signal);
+    double floatNs = nsPerWindow(floatEngine, signal);
+
+    fmt::println("double engine ({}-point FFT): {:8.0f} ns / window",
+                 DoubleSpectrumEngine<WINDOW_SIZE>::FFT_LEN, doubleNs);
+    fmt::println("float engine  ({}-point FFT): {:8.0f} ns / window",
+                 FloatSpectrumEngine<WINDOW_SIZE>::FFT_LEN, floatNs);
+    fmt::println("speedup: {:.2f}x\n", doubleNs / floatNs);
+
+    fmt::println("float vs double FFT, max error: {:.1f} dB below peak\n",
+                 floatFftErrorDb(signal));
+
+    auto doubleBins = normalizedBins(doubleEngine, signal);
+    auto floatBins = normalizedBins(floatEngine, signal);
+
+    fmt::println("Display bin shares (double / float):");
+    for (size_t bin = 0; bin < proc_thread::NUM_SPECTROGRAM_BINS; bin++) {
+        fmt::println("  bin {}: {:.3f} / {:.3f}", bin, doubleBins[bin], floatBins[bin]);
+    }
+
+    fmt::println("\nWindows of {} samples, computed at compile time:", WINDOW_SIZE);
+    printWindowNormalization<dsp::WindowType::Hann>();
+    printWindowNormalization<dsp::WindowType::Hamming>();
+    printWindowNormalization<dsp::WindowType::BlackmanHarris>();
+    printWindowNormalization<dsp::WindowType::Kaiser>();
+}
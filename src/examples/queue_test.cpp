@@ -1,5 +1,7 @@
 // Test program for the lock-free queue library.
 
+#include <audio_player/lib/doorbell.hpp>
+
 #include <rigtorp/SPSCQueue.h>
 
 #include <array>
@@ -20,6 +22,8 @@ struct Data {
 
 struct QueueHolder {
     SPSCQueue<Data> &queueRef;
+    // Rung after each push, so the receiver can sleep instead of spinning.
+    Doorbell &doorbell;
 };
 
 static constexpr std::size_t QUEUE_CAP = 20;
@@ -28,18 +32,23 @@ int main() {
     std::cout << "Test!" << std::endl;
 
     SPSCQueue<Data> mainThreadRx{QUEUE_CAP};
-    QueueHolder mainThrdRxHolder{mainThreadRx};
+    Doorbell mainThreadDoorbell;
+    QueueHolder mainThrdRxHolder{mainThreadRx, mainThreadDoorbell};
 
     std::atomic_bool running = true;
 
     SPSCQueue<Data> procThreadRx{QUEUE_CAP};
-    QueueHolder procThrdRxHolder{procThreadRx};
+    Doorbell procThreadDoorbell;
+    QueueHolder procThrdRxHolder{procThreadRx, procThreadDoorbell};
 
     // Processes data sent by producer thread.
     std::thread processor([mainThrdRxHolder, procThrdRxHolder, &running]() {
         while (true) {
-            while (running && !procThrdRxHolder.queueRef.front())
-                ;
+            uint32_t seenSequence = procThrdRxHolder.doorbell.sequence();
+            if (running && !procThrdRxHolder.queueRef.front()) {
+                procThrdRxHolder.doorbell.wait(seenSequence);
+                continue;
+            }
             if (!running) {
                 break;
             }
@@ -48,6 +57,7 @@ int main() {
             procThrdRxHolder.queueRef.pop();
             rxData.data[0] *= 2;
             mainThrdRxHolder.queueRef.push(rxData);
+            mainThrdRxHolder.doorbell.ring();
         }
     });
 
@@ -58,7 +68,9 @@ int main() {
             newData.data[0] = i;
 
             // If queue is full, drop data and move on.
-            bool _ = procThrdRxHolder.queueRef.try_push(newData);
+            if (procThrdRxHolder.queueRef.try_push(newData)) {
+                procThrdRxHolder.doorbell.ring();
+            }
 
             std::this_thread::sleep_for(std::chrono::milliseconds(500));
         }
@@ -66,8 +78,11 @@ int main() {
 
     uint32_t rxed = 0;
     while (rxed < 10) {
-        while (!mainThreadRx.front())
-            ;
+        uint32_t seenSequence = mainThreadDoorbell.sequence();
+        if (!mainThreadRx.front()) {
+            mainThreadDoorbell.wait(seenSequence);
+            continue;
+        }
         std::cout << std::to_string(mainThreadRx.front()->data[0]) << std::endl;
         mainThreadRx.pop();
         rxed++;
@@ -75,6 +90,7 @@ int main() {
 
     std::cout << "Done!" << std::endl;
     running = false;
+    procThreadDoorbell.ring();
     processor.join();
     std::cout << "Processor thread shut down!" << std::endl;
 
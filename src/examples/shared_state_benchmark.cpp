@@ -0,0 +1,220 @@
+// Measures how much a UI thread polling the shared playback state slows the
+// playback thread's per-period updates, with the state laid out as
+// SharedPlaybackState used to have it, and as it is now.
+//
+// The old layout packed the controls the UI writes and the meters the
+// playback thread writes into adjacent atomics. Now the controls are
+// SharedPlaybackState::Controls, on their own cache line, and the meters go
+// to the UI as a PlaybackSnapshot through a TripleBuffer.
+//
+// The "playback" thread reads the controls and publishes the meters, as the
+// playback loop does every period. The "UI" thread reads the controls and the
+// meters, like the console does every frame, but as fast as it can. When the
+// two share a cache line, each of those reads pulls the line away from the
+// playback thread, and its next store has to fetch it back.
+//
+// Both layouts publish the same whole PlaybackSnapshot every period, so only
+// the layout differs. The two threads are pinned to different CPUs, since the
+// lines only move between caches when they run on different cores; with a
+// single CPU the numbers mostly measure time slicing.
+
+#include <audio_player/lib/alsa_player.hpp>
+#include <audio_player/lib/playback_stats.hpp>
+#include <audio_player/lib/rt_queue.hpp>
+#include <audio_player/lib/rt_thread.hpp>
+
+#include <fmt/base.h>
+#include <fmt/core.h>
+
+#include <sched.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+constexpr size_t NUM_PERIODS = 20'000'000;
+
+// The snapshot as whole words, so the packed layout can keep it in atomics.
+static_assert(std::is_trivially_copyable_v<PlaybackSnapshot>);
+constexpr size_t SNAPSHOT_WORDS = (sizeof(PlaybackSnapshot) + 7) / 8;
+using SnapshotWords = std::array<uint64_t, SNAPSHOT_WORDS>;
+
+static SnapshotWords toWords(const PlaybackSnapshot &snapshot) {
+    SnapshotWords words{};
+    std::memcpy(words.data(), &snapshot, sizeof(snapshot));
+    return words;
+}
+
+// SharedPlaybackState before the controls and meters were split up: the
+// meters are relaxed atomics right after the controls. The meters are the
+// current snapshot, a word per atomic. The UI may see words from different
+// periods, which doesn't matter for timing.
+struct PackedState {
+    std::atomic_bool mPlaying = true;
+    std::atomic_bool mBoost = false;
+    std::array<std::atomic<uint64_t>, SNAPSHOT_WORDS> mSnapshot{};
+
+    bool playing() const {
+        return mPlaying.load(std::memory_order_relaxed);
+    }
+
+    bool boost() const {
+        return mBoost.load(std::memory_order_relaxed);
+    }
+
+    // Playback side.
+    void publish(const PlaybackSnapshot &snapshot) {
+        SnapshotWords words = toWords(snapshot);
+        for (size_t i = 0; i < SNAPSHOT_WORDS; i++) {
+            mSnapshot[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    // UI side.
+    uint64_t poll() {
+        uint64_t sum = playing() + boost();
+        for (const std::atomic<uint64_t> &word : mSnapshot) {
+            sum += word.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+// The controls and snapshot of the current SharedPlaybackState.
+struct IsolatedState {
+    IsolatedState() {
+        mControls.mPlaying = true;
+    }
+
+    SharedPlaybackState::Controls mControls;
+    TripleBuffer<PlaybackSnapshot> mSnapshot;
+
+    bool playing() const {
+        return mControls.mPlaying.load(std::memory_order_relaxed);
+    }
+
+    bool boost() const {
+        return mControls.mBoost.load(std::memory_order_relaxed);
+    }
+
+    void publish(const PlaybackSnapshot &snapshot) {
+        mSnapshot.publish(snapshot);
+    }
+
+    uint64_t poll() {
+        uint64_t sum = playing() + boost();
+        mSnapshot.update();
+        for (uint64_t word : toWords(mSnapshot.front())) {
+            sum += word;
+        }
+        return sum;
+    }
+};
+
+// Two CPUs this process may run on, for the playback and UI threads, or
+// std::nullopt if it only has one.
+static std::optional<std::pair<int, int>> pickCpus() {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+        return std::nullopt;
+    }
+
+    std::array<int, 2> picked{-1, -1};
+    size_t numPicked = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && numPicked < picked.size(); cpu++) {
+        if (CPU_ISSET(cpu, &cpus)) {
+            picked[numPicked++] = cpu;
+        }
+    }
+    if (numPicked < picked.size()) {
+        return std::nullopt;
+    }
+    return std::pair{picked[0], picked[1]};
+}
+
+// Nanoseconds per period on the playback side, optionally with the UI polling
+// from pollerCpu, or from wherever the scheduler puts it if that is negative.
+template <typename State>
+static double nsPerPeriod(bool withPoller, int pollerCpu) {
+    State state;
+    std::atomic_bool polling = true;
+    std::atomic<uint64_t> polls = 0;
+
+    std::thread poller;
+    if (withPoller) {
+        poller = std::thread([&state, &polling, &polls, pollerCpu]() {
+            if (pollerCpu >= 0) {
+                rt_thread::pinToCpu(pollerCpu);
+            }
+            uint64_t count = 0;
+            while (polling.load(std::memory_order_relaxed)) {
+                count += state.poll();
+            }
+            polls = count;
+        });
+    }
+
+    // What the playback loop keeps and publishes every period.
+    PlaybackStats stats;
+    PlaybackSnapshot snapshot;
+    snapshot.mNumTicks = NUM_PERIODS;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < NUM_PERIODS && state.playing(); i++) {
+        bool boost = state.boost();
+        snapshot.mAvgIntensity = 0.6f * snapshot.mAvgIntensity + (boost ? 0.5f : 0.4f);
+        snapshot.mTickNum = i;
+
+        stats.recordPeriod(i % 1000);
+        snapshot.mStats = stats.snapshot();
+        state.publish(snapshot);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    polling = false;
+    if (poller.joinable()) {
+        poller.join();
+    }
+    // Keep the polling from being optimized away.
+    if (polls == UINT64_MAX) {
+        fmt::println("");
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / NUM_PERIODS;
+}
+
+int main() {
+    fmt::println("Cache line size: {} bytes", CACHE_LINE_SIZE);
+    fmt::println("sizeof(PackedState) = {}, sizeof(IsolatedState) = {}, snapshot: {} bytes",
+                 sizeof(PackedState), sizeof(IsolatedState), sizeof(PlaybackSnapshot));
+
+    int pollerCpu = -1;
+    if (std::optional<std::pair<int, int>> cpus = pickCpus()) {
+        rt_thread::pinToCpu(cpus->first);
+        pollerCpu = cpus->second;
+        fmt::println("Playback thread on CPU {}, UI thread on CPU {}.\n", cpus->first,
+                     cpus->second);
+    } else {
+        fmt::println("Only one CPU available, so the threads take turns on it and no cache "
+                     "lines move between cores. Run this on a machine with two or more.\n");
+    }
+
+    fmt::println("{:<28} {:>12}", "layout", "ns / period");
+    fmt::println("{:<28} {:>12.2f}", "packed, no poller",
+                 nsPerPeriod<PackedState>(false, pollerCpu));
+    fmt::println("{:<28} {:>12.2f}", "packed, UI polling",
+                 nsPerPeriod<PackedState>(true, pollerCpu));
+    fmt::println("{:<28} {:>12.2f}", "isolated, no poller",
+                 nsPerPeriod<IsolatedState>(false, pollerCpu));
+    fmt::println("{:<28} {:>12.2f}", "isolated, UI polling",
+                 nsPerPeriod<IsolatedState>(true, pollerCpu));
+
+    return 0;
+}